@@ -67,5 +67,11 @@ namespace sp
     {
         return clock::time_point{clock::duration{0}};
     }
+
+    /* deadline of something that has no deadline, unlike never() it is later than any other time point */
+    constexpr clock::time_point no_deadline()
+    {
+        return clock::time_point::max();
+    }
 }
 #endif
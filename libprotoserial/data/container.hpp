@@ -140,7 +140,7 @@ namespace sp
             return *this;
         }
         /* move */
-        bytes(bytes && other)
+        bytes(bytes && other) noexcept
         {
             _data = other.get_base();
             _length = other.size();
@@ -148,7 +148,7 @@ namespace sp
             _capacity = other.capacity();
             other._init();
         }
-        bytes & operator= (bytes && other)
+        bytes & operator= (bytes && other) noexcept
         {
             clear();
             _data = other.get_base();
@@ -65,6 +65,7 @@
 #include "libprotoserial/fragmentation/transfer.hpp"
 
 #include <memory>
+#include <span>
 
 #ifndef SP_NO_IOSTREAM
 #include <iostream>
@@ -160,17 +161,36 @@ namespace sp
 
 
         virtual void receive_callback(fragment p) = 0;
+        /* fragments received by a single interface pass, handlers can override this to group 
+        the fragments by transfer and answer them all at once, the fragments may be moved from */
+        virtual void receive_batch_callback(std::span<fragment> batch)
+        {
+            for (auto & f : batch)
+                receive_callback(std::move(f));
+        }
         virtual void main_task() = 0;
         virtual void transmit(transfer t) = 0;
 
+        /* true when main_task has something to do right away */
+        virtual bool has_work() const noexcept {return false;}
+        /* time point at which main_task needs to be called even if has_work() stays false (retransmits, 
+        timeouts), no_deadline() when nothing is in flight. Handlers with timers must override this, 
+        the default keeps a handler which does not track them polled (see base_minimal_handler) */
+        virtual clock::time_point next_deadline() const noexcept {return clock::now();}
+
+        /* called through the interface's transmit_began_event */
+        virtual void transmit_began_callback(object_id_type id) {}
+
         /* shortcut for event subscribe */
         void bind_to(interface & l)
         {
-            l.receive_event.subscribe(&fragmentation_handler::receive_callback, this);
-            l.transmit_began_event.subscribe(&fragmentation_handler::transmit_began_callback, this);
-            transmit_event.subscribe(&interface::transmit, &l);
+            l.receive_batch_event.subscribe<&fragmentation_handler::receive_batch_callback>(this);
+            l.transmit_began_event.subscribe<&fragmentation_handler::transmit_began_callback>(this);
+            transmit_event.subscribe<&interface::transmit>(&l);
         }
 
+        interface_identifier interface_id() const noexcept {return _interface->interface_id();}
+
         /* fires when the handler wants to transmit a fragment, complemented by receive_callback */
         subject<fragment> transmit_event;
         /* fires when the handler receives and fully reconstructs a fragment, complemented by transmit */
@@ -180,7 +200,6 @@ namespace sp
 
         protected:
 
-        virtual void transmit_began_callback(object_id_type id) {}
         template<typename Header>
         struct transfer_handler : public transfer
         {
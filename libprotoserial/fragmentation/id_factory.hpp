@@ -22,14 +22,20 @@
 #ifndef _SP_FRAGMENTATION_ID_FACTORY
 #define _SP_FRAGMENTATION_ID_FACTORY
 
+#include "libprotoserial/libconfig.hpp"
 #include "libprotoserial/interface/interface_id.hpp"
+#include "libprotoserial/utils/atomic.hpp"
 
-#include <list>
-#include <algorithm>
+#include <cstdint>
+#include <mutex>
 
 namespace sp
 {
 
+    /* issues transfer IDs per interface, as per spec. Every interface has a single counter, 
+    shared by all the threads which create transfers for it (the stack's thread, user threads, 
+    the python bindings), so the IDs never repeat on the wire. The counters are only ever added, 
+    the lookup of an existing one does not lock */
     struct id_factory
     {
         using id_type = uint;
@@ -38,40 +44,69 @@ namespace sp
         struct mapper
         {
             interface_identifier interface_id;
-            id_type id_count;
+            atomic<id_type> id_count;
+            mapper * next;
 
-            mapper(interface_identifier iid) : 
-                interface_id(iid), id_count(0) {}
+            mapper(interface_identifier iid, mapper * n) : 
+                interface_id(iid), id_count(0), next(n) {}
         };
 
-        std::list<mapper> _mappers;
+        atomic<mapper*> _mappers{nullptr};
+        mutex _mutex;
 
-        id_type increment_id(id_type & id_counter)
+        mapper * find(interface_identifier iid) const noexcept
         {
-            ++id_counter;
-            if ((std::uint8_t)id_counter == 0) ++id_counter;
-            return id_counter;
+            for (auto m = _mappers.load(std::memory_order_acquire); m; m = m->next)
+                if (m->interface_id == iid)
+                    return m;
+            return nullptr;
+        }
+
+        mapper & get(interface_identifier iid)
+        {
+            if (auto m = find(iid))
+                return *m;
+            std::lock_guard lock(_mutex);
+            /* another thread may have added it in the meantime */
+            if (auto m = find(iid))
+                return *m;
+            auto m = new mapper(iid, _mappers.load(std::memory_order_relaxed));
+            _mappers.store(m, std::memory_order_release);
+            return *m;
         }
 
         public:
 
-        id_type new_id(interface_identifier iid)
+        id_factory() = default;
+        id_factory(const id_factory &) = delete;
+        id_factory & operator=(const id_factory &) = delete;
+
+        ~id_factory()
         {
-            auto mit = std::find_if(_mappers.begin(), _mappers.end(), [&](const auto & mp){
-                return mp.interface_id == iid;
-            });
-            if (mit == _mappers.end())
+            for (auto m = _mappers.load(); m;)
             {
-                auto & m = _mappers.emplace_back(iid);
-                return increment_id(m.id_count);
+                auto next = m->next;
+                delete m;
+                m = next;
             }
-            else
-                return increment_id(mit->id_count);
+        }
+
+        id_type new_id(interface_identifier iid)
+        {
+            auto & counter = get(iid).id_count;
+            id_type id = counter.load(std::memory_order_relaxed), next;
+            do
+            {
+                /* the lower byte of an ID is never zero */
+                next = id + 1;
+                if ((std::uint8_t)next == 0) ++next;
+            } while (!counter.compare_exchange_weak(id, next, std::memory_order_relaxed));
+            return next;
         }
     };
 
-    /* ID factory that issues transfer IDs based on the interface, as per spec */
-    static id_factory global_id_factory;
+    /* the one ID factory of the process, see id_factory */
+    inline id_factory global_id_factory;
 }
 
 
@@ -91,7 +91,7 @@ namespace sp
         size_type max_fragment_data_size() const
         {
             /* _interface->max_data_size() is the maximum size of a fragment's data */
-            return _interface->max_data_size() - sizeof(Header)
+            return _interface->max_data_size() - sizeof(Header);
         }
 
         
@@ -106,8 +106,69 @@ namespace sp
             return std::find_if(_incoming_transfers.begin(), _incoming_transfers.end(), pred);
         }
 
+        const peer_state * peer_get(address_type addr) const noexcept
+        {
+            for (const auto & ps : _peer_states)
+                if (ps.addr == addr)
+                    return &ps;
+            return nullptr;
+        }
+
+        /* how long a transfer may go without any progress before it is retransmitted or purged */
+        clock::duration inactivity_timeout(const peer_state * peer) const noexcept
+        {
+            return rate2duration(peer ? peer->tx_rate : _config.peer_rate, max_fragment_data_size()) * 
+                _config.inactivity_timeout_multiplier;
+        }
+
+        static bool waits_for_transmit(const tr_wrapper & t) noexcept
+        {
+            return t.state == tr_states::NEW || t.state == tr_states::NEXT || t.state == tr_states::RETRY;
+        }
+
+        clock::time_point outgoing_deadline(const tr_wrapper & t) const noexcept
+        {
+            auto peer = peer_get(t.destination());
+            /* the next fragment goes out once the peer's transmit holdoff is over */
+            if (waits_for_transmit(t))
+                return peer ? peer->tx_holdoff : clock::now();
+            /* otherwise we are waiting for the ACK */
+            return t.sent_at + inactivity_timeout(peer);
+        }
+
+        clock::time_point incoming_deadline(const tr_wrapper & t) const noexcept
+        {
+            auto peer = peer_get(t.source());
+            if (!peer || peer->last_rx == never())
+                return clock::now();
+            return peer->last_rx + inactivity_timeout(peer);
+        }
 
 
+
+        public:
+
+        /* an outgoing transfer has a fragment which can be sent right away */
+        bool has_work() const noexcept
+        {
+            auto now = clock::now();
+            return std::any_of(_outgoing_transfers.begin(), _outgoing_transfers.end(), [&](const tr_wrapper & t){
+                return waits_for_transmit(t) && outgoing_deadline(t) <= now;
+            });
+        }
+
+        /* the earliest retransmit, inactivity timeout or end of a transmit holdoff of the transfers 
+        in flight, no_deadline() when there are none */
+        clock::time_point next_deadline() const noexcept
+        {
+            auto deadline = no_deadline();
+            for (const auto & t : _outgoing_transfers)
+                deadline = std::min(deadline, outgoing_deadline(t));
+            for (const auto & t : _incoming_transfers)
+                deadline = std::min(deadline, incoming_deadline(t));
+            return deadline;
+        }
+
         void transmit_began_callback(object_id_type id)
         {
             auto pt = find_outgoing([id](const tr_wrapper & tr){
@@ -119,8 +180,6 @@ namespace sp
             }
         }
 
-        public:
-
         void transmit(transfer t)
         {
 #ifdef SP_FRAGMENTATION_DEBUG
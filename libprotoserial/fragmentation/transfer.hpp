@@ -66,7 +66,7 @@ namespace sp
         transfer_metadata create_response() 
         {
             return transfer_metadata(destination(), source(), interface_id(), 
-                clock::now(), global_id_factory.new_id(interface_id()), get_id()
+                fragment_metadata::stamp(), global_id_factory.new_id(interface_id()), get_id()
             );
         }
 
@@ -86,13 +86,13 @@ namespace sp
         /* constructor used when the fragmentation_handler receives the first piece of the transfer */
         template<class Header>
         transfer(interface_identifier iid, const Header & h) :
-            transfer_metadata(0, 0, iid, clock::now(), h.get_id(), h.get_prev_id()),
+            transfer_metadata(0, 0, iid, fragment_metadata::stamp(), h.get_id(), h.get_prev_id()),
             transfer_data(h.fragments_total()) {}
 
         transfer(interface_identifier iid, id_type prev_id = 0):
-            transfer_metadata(0, 0, iid, clock::now(), global_id_factory.new_id(iid), prev_id) {}
+            transfer_metadata(0, 0, iid, fragment_metadata::stamp(), global_id_factory.new_id(iid), prev_id) {}
         transfer(const interface & i, id_type prev_id = 0):
-            transfer_metadata(0, 0, i.interface_id(), clock::now(), global_id_factory.new_id(i.interface_id()), prev_id) {}
+            transfer_metadata(0, 0, i.interface_id(), fragment_metadata::stamp(), global_id_factory.new_id(i.interface_id()), prev_id) {}
 
         transfer(transfer_metadata && metadata, data_type && data):
             transfer_metadata(std::move(metadata)), _data(std::move(data)) {}
@@ -36,6 +36,9 @@
 
 #ifdef SP_LINUX
 #include "libprotoserial/interface/linux/uart.hpp"
+#ifdef SP_IO_URING
+#include "libprotoserial/interface/linux/uring_uart.hpp"
+#endif
 #endif
 
 namespace sp
@@ -68,6 +71,14 @@ namespace sp
     };
 #endif
 
+#if defined(SP_LINUX) && defined(SP_IO_URING)
+    class uring_uart_interface:
+        public detail::pc::uring_uart_interface<sp::headers::interface_8b8b, sp::footers::crc32>
+    {
+        using detail::pc::uring_uart_interface<sp::headers::interface_8b8b, sp::footers::crc32>::uring_uart_interface;
+    };
+#endif
+
 }
 
 #endif
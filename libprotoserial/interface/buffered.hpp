@@ -25,6 +25,8 @@
 #include "libprotoserial/interface/interface.hpp"
 #include "libprotoserial/interface/parsers.hpp"
 
+#include <vector>
+
 
 #ifndef SP_NO_IOSTREAM
 //#define SP_BUFFERED_DEBUG
@@ -155,6 +157,27 @@ namespace sp
             	*_write_it = b;
             }
 
+            /* for drivers which receive in blocks straight into the buffer (DMA, io_uring), the free space 
+            following the last written byte up to the end of the buffer, the received bytes are then 
+            published using rx_buffer_commit */
+            std::span<byte> rx_buffer_contiguous()
+            {
+                bytes::pointer next = _write_it + 1;
+                if (next >= _rx_buffer.end())
+                    next = _rx_buffer.begin();
+                return std::span<byte>(next, _rx_buffer.end());
+            }
+            /* publishes count bytes written to the beginning of rx_buffer_contiguous() */
+            void rx_buffer_commit(bytes::size_type count)
+            {
+                if (count == 0)
+                    return;
+                auto region = rx_buffer_contiguous();
+                _postpone_by_one = false;
+                _write_it = region.data() + count - 1;
+                _byte_count = _byte_count + count;
+            }
+
             /* advances the buffer pointer by one, wraps if necessary, call this in receive complete interrupt */
 			inline void rx_buffer_advance()
 			{
@@ -193,6 +216,8 @@ namespace sp
             }
 
             bytes::size_type overhead_size() const noexcept {return sizeof(Header) + sizeof(Footer) + preamble_length;}
+            /* bytes received since the last do_receive are waiting to be parsed */
+            bool has_work() const noexcept {return interface::has_work() || _last_byte_count != _byte_count;}
             bytes::size_type max_data_size() const noexcept {return _max_fragment_size - overhead_size();}
             
             protected:
@@ -202,6 +227,7 @@ namespace sp
 
             bytes::size_type do_receive() noexcept
             {
+                SP_TRACE_SCOPE("do_receive", rx_buffer_size());
                 do_single_receive();
                 /* while we are trying to parse the buffer, the ISR is continually filling it
                 _write is the position of the last byte written, so we can read up to that point
@@ -252,6 +278,17 @@ namespace sp
                                 /* once again, check that there are enough bytes in the buffer, this can still fail */
                                 if ((size_t)distance(fragment_start, write) + 1 >= fragment_size)
                                 {
+                                    /* on a shared bus most fragments are someone else's, when nobody listens to 
+                                    those the fragment is skipped without copying it out and computing the hash. 
+                                    The Header's check alone is too weak to skip a whole fragment's worth of bytes 
+                                    on, noise could swallow the valid fragments behind it, so the next preamble 
+                                    must follow right after it, otherwise the fragment goes through the full parse */
+                                    if (_is_foreign(h) && (size_t)distance(fragment_start, write) >= fragment_size && 
+                                        *(read + fragment_size + 1) == preamble)
+                                    {
+                                        _read = read = read + fragment_size;
+                                        continue;
+                                    }
                                     /* we have received the entire fragment, prepare it for parsing */
                                     auto b = parsers::byte_copy(fragment_start, fragment_start + fragment_size);
                                     try
@@ -260,10 +297,10 @@ namespace sp
 #ifdef SP_BUFFERED_DEBUG
                                         std::cout << "do_receive parse_fragment gets: " << b << std::endl;
 #endif
-                                        put_received(std::move(parsers::parse_fragment<Header, Footer>(std::move(b), *this)));
+                                        _rx_batch.push_back(parsers::parse_fragment<Header, Footer>(std::move(b), *this));
                                         /* parsing succeeded, finally move the read pointer, we do not include the
                                         preamble length here because we don't necessarily know how long it was originally */
-                                        _read = read + fragment_size;
+                                        _read = read = read + fragment_size;
 #ifdef SP_BUFFERED_DEBUG
                                         std::cout << "do_receive after parse" << std::endl;
 #endif
@@ -271,12 +308,14 @@ namespace sp
                                     catch(std::exception &e)
                                     {
                                         /* parsing failed, move by one because there is no need to try and parse this again */
-                                        _read = read + 1;
+                                        _read = read = read + 1;
 #ifdef SP_BUFFERED_WARNING
                                         std::cout << "do_receive parse exception: " << e.what() << '\n';
 #endif
                                     }
-                                    goto END;
+                                    /* keep going, all the fragments which are already complete are 
+                                    delivered together */
+                                    continue;
                                 }
                                 else
                                 {
@@ -312,6 +351,9 @@ namespace sp
                     }
                 }
                 END:
+                put_received(std::span<fragment>(_rx_batch));
+                /* keeps the capacity for the next pass */
+                _rx_batch.clear();
 #ifdef SP_BUFFERED_DEBUG
                 std::cout << "do_receive returning at: " << _read._current - _read._begin << " of " << this->_write_it - _read._begin << std::endl;
 #endif
@@ -323,21 +365,63 @@ namespace sp
                 /* Header */
                 p.data().push_front(to_bytes(Header(p)));
                 /* preamble */
-                auto pr = bytes(parent::preamble_length);
-                pr.set(parent::preamble);
+                auto pr = bytes(preamble_length);
+                pr.set(preamble);
                 p.data().push_front(pr);
                 /* Footer */
                 p.data().push_back(to_bytes(Footer(
-                    p.data().begin() + parent::preamble_length, p.data().end()
+                    p.data().begin() + preamble_length, p.data().end()
                 )));
 #ifdef SP_BUFFERED_DEBUG
-                std::cout << "serialize_fragment returning: " << b << std::endl;
+                std::cout << "serialize_fragment returning: " << p.data() << std::endl;
 #endif
-                return b;
+                return std::move(p.data());
+            }
+
+            /* number of bytes p takes up once serialized */
+            bytes::size_type serialized_size(const fragment & p) const noexcept
+            {
+                return p.data().size() + overhead_size();
+            }
+
+            /* same format as serialize_fragment but written into a buffer owned by the driver, which must
+            hold at least serialized_size(p) bytes. The Footer's hash is computed while the Header and 
+            the data are being copied, so the data is only read once. Returns the number of bytes written */
+            bytes::size_type serialize_into(const fragment & p, byte * out) const noexcept
+            {
+                auto it = out;
+                for (typename Header::size_type i = 0; i < preamble_length; ++i)
+                    *it++ = preamble;
+
+                typename Footer::hash_algorithm hash;
+                auto copy_hashed = [&](const byte * begin, const byte * end){
+                    for (; begin != end; ++begin)
+                    {
+                        hash.add(static_cast<std::uint8_t>(*begin));
+                        *it++ = *begin;
+                    }
+                };
+                Header h(p);
+                copy_hashed(reinterpret_cast<const byte*>(&h), reinterpret_cast<const byte*>(&h) + sizeof(h));
+                copy_hashed(p.data().begin(), p.data().end());
+
+                Footer f;
+                f.hash = hash.value();
+                it = std::copy(reinterpret_cast<const byte*>(&f), reinterpret_cast<const byte*>(&f) + sizeof(f), it);
+                return it - out;
+            }
+
+            bool _is_foreign(const Header & h) const noexcept
+            {
+                return interface::address_type(h.destination) != get_address() && 
+                    interface::address_type(h.destination) != get_broadcast_address() && 
+                    other_receive_event.empty();
             }
 
             buffered_interface::circular_iterator _read;
             uint _max_fragment_size, _last_byte_count;
+            /* fragments completed by the current do_receive pass */
+            std::vector<fragment> _rx_batch;
         };
     }
 } // namespace sp
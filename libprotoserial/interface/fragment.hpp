@@ -37,29 +37,51 @@ namespace sp
         public:
         /* an integer that can hold any used device address, the actual address format 
         is interface specific, address 0 is reserved internally and should never appear 
-        in a fragment */
-        using address_type = uint;
+        in a fragment. All the current headers use 8 bit addresses, 16 bits leave room
+        while keeping the metadata small */
+        using address_type = std::uint16_t;
         using time_point = clock::time_point;
 
-        fragment_metadata(address_type src, address_type dst, interface_identifier iid, time_point timestamp_creation):
-            _timestamp_creation(timestamp_creation), _interface_id(iid), _source(src), _destination(dst) {}
+        fragment_metadata(address_type src, address_type dst, interface_identifier iid, [[maybe_unused]] time_point timestamp_creation):
+#ifndef SP_NO_TIMESTAMPS
+            _timestamp_creation(timestamp_creation),
+#endif
+            _source(src), _destination(dst), _interface_id(iid) {}
 
         fragment_metadata(const fragment_metadata &) = default;
         fragment_metadata(fragment_metadata &&) = default;
         fragment_metadata & operator=(const fragment_metadata &) = default;
         fragment_metadata & operator=(fragment_metadata &&) = default;
 
+#ifndef SP_NO_TIMESTAMPS
         constexpr time_point timestamp_creation() const noexcept {return _timestamp_creation;}
+#else
+        constexpr time_point timestamp_creation() const noexcept {return never();}
+#endif
         constexpr interface_identifier interface_id() const noexcept {return _interface_id;}
         constexpr address_type source() const noexcept {return _source;}
         constexpr address_type destination() const noexcept {return _destination;}
 
         void set_destination(address_type dst) {_destination = dst;}
 
+        /* creation timestamp for new metadata, with SP_NO_TIMESTAMPS defined the clock 
+        is not read at all and timestamp_creation() returns never() */
+        static time_point stamp() noexcept
+        {
+#ifndef SP_NO_TIMESTAMPS
+            return clock::now();
+#else
+            return never();
+#endif
+        }
+
         protected:
+        /* largest first, the derived metadata (transfer IDs) fills the tail padding */
+#ifndef SP_NO_TIMESTAMPS
         time_point _timestamp_creation;
-        interface_identifier _interface_id;
+#endif
         address_type _source, _destination;
+        interface_identifier _interface_id;
     };
 
     /* interface fragment representation */
@@ -70,7 +92,7 @@ namespace sp
         typedef bytes   data_type;
 
         fragment(address_type src, address_type dst, data_type && d, interface_identifier iid) :
-            fragment_metadata(src, dst, iid, clock::now()), _data(std::move(d)) {}
+            fragment_metadata(src, dst, iid, stamp()), _data(std::move(d)) {}
 
         fragment(fragment_metadata && metadata, data_type && d):
             fragment_metadata(std::move(metadata)), _data(std::move(d)) {}
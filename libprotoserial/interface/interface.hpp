@@ -105,14 +105,51 @@
 #define _SP_INTERFACE_INTERFACE
 
 #include "libprotoserial/utils/observer.hpp"
+#include "libprotoserial/utils/trace.hpp"
+#include "libprotoserial/utils/wakeup.hpp"
 #include "libprotoserial/interface/fragment.hpp"
 #include "libprotoserial/data/prealloc_size.hpp"
 
 #include <string>
 #include <queue>
+#include <exception>
+#include <span>
+#include <vector>
 
 namespace sp
 {
+    /* the fragments passed to the receive_batch_event subscribers, which take them as a span. A span of 
+     * const fragments is handed out to any number of subscribers as is, a span of (mutable) fragments 
+     * only to the last one (see subject::emit), the others get a copy of the batch with copies of the 
+     * fragments, so a subscriber which moves the fragments out never leaves the next one moved-from ones
+     */
+    class fragment_batch
+    {
+        public:
+
+        explicit fragment_batch(std::span<fragment> fragments) noexcept : _fragments(fragments) {}
+        fragment_batch(const fragment_batch & other) :
+            _copies(other._fragments.begin(), other._fragments.end()), _fragments(_copies) {}
+        /* moving the vector keeps its storage, the span stays valid */
+        fragment_batch(fragment_batch && other) noexcept :
+            _copies(std::move(other._copies)), _fragments(other._fragments) {}
+        fragment_batch & operator=(const fragment_batch &) = delete;
+        fragment_batch & operator=(fragment_batch &&) = delete;
+
+        operator std::span<const fragment>() const noexcept {return _fragments;}
+        operator std::span<fragment>() && noexcept {return _fragments;}
+
+        std::size_t size() const noexcept {return _fragments.size();}
+        bool empty() const noexcept {return _fragments.empty();}
+        const fragment & operator[](std::size_t i) const noexcept {return _fragments[i];}
+        auto begin() const noexcept {return std::span<const fragment>(_fragments).begin();}
+        auto end() const noexcept {return std::span<const fragment>(_fragments).end();}
+
+        private:
+        std::vector<fragment> _copies;
+        std::span<fragment> _fragments;
+    };
+
     /* things left as implementation details for subclasses
      * - RX ISR and RX buffer (not the fragment queue)
      * - address (must be representable by interface::address), broadcast address
@@ -120,16 +157,17 @@ namespace sp
      */
     class interface
     {
-        struct serialized
-        {
-            bytes data;
-            object_id_type id;
-        };
-
         public:
 
         using address_type = fragment::address_type;
 
+        struct statistics
+        {
+            /* fragments which left the transmit queue but never made it to the wire, because they
+            could not be serialized or the driver failed to send them */
+            uint transmit_errors = 0;
+        };
+
         /* - name should uniquely identify the interface on this device
          * - address is the interface address, when a fragment is received where destination() == address
          *   then the receive_event is emitted, otherwise the other_receive_event is emitted
@@ -145,16 +183,31 @@ namespace sp
             /* if there is something in the queue, transmit it */
             if (!_tx_queue.empty() && can_transmit())
             {
-                if (do_transmit(std::move(_tx_queue.front().data)))
+                auto id = _tx_queue.front().object_id();
+                bool began;
+                try
                 {
-                    transmit_began_event.emit(_tx_queue.front().id);
+                    began = transmit_fragment(_tx_queue.front());
+                }
+                catch (std::exception &)
+                {
+                    /* the fragment cannot be serialized, there is no point in retrying */
+                    _tx_serialized = bytes();
+                    count_transmit_error();
                     _tx_queue.pop();
+                    return;
                 }
+                if (!began)
+                    return;
+                /* the subscribers are outside of the try, the fragment is on its way whatever they do */
+                _tx_queue.pop();
+                transmit_began_event.emit(id);
             }
         }
 
         /* fills the source address and puts the fragment into the transmit queue 
-        provided that the queue is not already full and p.data().size() is within [1, max_data_size()] */
+        provided that the queue is not already full and p.data().size() is within [1, max_data_size()],
+        the fragment is kept as is until it reaches the front of the queue */
         void transmit(fragment p)
         {
             /* sanity checks */
@@ -162,14 +215,39 @@ namespace sp
             {
                 /* complete the fragment */
                 p.complete(get_address(), interface_id());
-                auto id = p.object_id();
-                _tx_queue.emplace(std::move(serialize_fragment(std::move(p))), id);
+                _tx_queue.push(std::move(p));
+            }
+        }
+
+        /* puts a fragment received on another interface into the transmit queue, unlike transmit the
+        source address is kept, only the interface is updated. Returns false when the fragment was refused */
+        bool forward(fragment p)
+        {
+            if (is_writable() && p.destination() != 0 && p.data().size() <= max_data_size() && !p.data().is_empty())
+            {
+                p.complete(p.source(), interface_id());
+                _tx_queue.push(std::move(p));
+                return true;
             }
+            return false;
         }
 
+        /* true when main_task has something to do right away, queued fragments only count once the 
+        driver can start a transmit, the driver's completion (interrupt, fd) ends the wait otherwise */
+        virtual bool has_work() const noexcept {return !_tx_queue.empty() && can_transmit();}
+        /* time point at which main_task needs to be called even if has_work() stays false */
+        virtual clock::time_point next_deadline() const noexcept {return no_deadline();}
+        /* file descriptor which becomes readable when data arrives, -1 when there is none */
+        virtual int native_handle() const noexcept {return -1;}
+        /* the wakeup gets notified when data is received outside of main_task, see notify_work() */
+        void set_wakeup(wakeup * w) noexcept {_wakeup = w;}
+
         bool is_writable() const {return _tx_queue.size() <= _max_queue_size;}
         uint writable_count() const {return _max_queue_size - _tx_queue.size();}
         
+        const statistics & get_statistics() const noexcept {return _statistics;}
+        void reset_statistics() noexcept {_statistics = statistics();}
+
         interface_identifier interface_id() const noexcept {return _interface_id;}
         address_type get_address() const noexcept {return _address;}
         address_type get_broadcast_address() const noexcept {return _broadcast_address;}
@@ -182,6 +260,11 @@ namespace sp
         /* emitted by the main_task function when a new fragment is received where the destination address matches
         the interface address */
         subject<fragment> receive_event;
+        /* emitted by the main_task function with the consecutive fragments addressed to this interface 
+        which were received in one pass, subscribers taking a std::span<fragment> may move the fragments 
+        out (see fragment_batch). When this has subscribers, receive_event subscribers get copies of the 
+        fragments before the batch is emitted */
+        subject<fragment_batch> receive_batch_event;
         /* emitted by the main_task function when a new fragment is received where the destination address matches
         the interface broadcast address */
         subject<fragment> broadcast_receive_event;
@@ -193,38 +276,111 @@ namespace sp
 
         protected:
 
-        /* TX (serialize_fragment => can_transmit => do_transmit) */
+        /* TX (can_transmit => transmit_fragment => serialize_fragment => do_transmit) */
         /* fragment serialization is implemented here, exceptions can be thrown 
         the serialized fragment well be passed to transmit after can_transmit() returns true */
         virtual bytes serialize_fragment(fragment && p) const = 0;
+        /* called from the main_task after can_transmit() returns true with the fragment from the front 
+        of the queue, so the fragment is serialized only once it is about to be sent. Drivers with a 
+        transmit buffer of their own override this and serialize straight into it, the default serializes 
+        into a new container and passes it to do_transmit. Returning false keeps the fragment queued */
+        virtual bool transmit_fragment(fragment & p)
+        {
+            /* a previous attempt may have already serialized the fragment */
+            if (_tx_serialized.is_empty())
+                _tx_serialized = serialize_fragment(std::move(p));
+            if (!do_transmit(std::move(_tx_serialized)))
+                return false;
+            _tx_serialized = bytes();
+            return true;
+        }
         /* return true when the interface is ready to transmit */
-        virtual bool can_transmit() noexcept = 0;
+        virtual bool can_transmit() const noexcept = 0;
         /* transmit is implemented here, called from the main_task after can_transmit() returns true, 
         if the transmit fails for whatever reason, the transmit() function can return false and the 
         transmit will be reattempted with the same fragment later */
         virtual bool do_transmit(bytes && buff) noexcept = 0;
+        /* for drivers which find out about a failed transmit only after do_transmit has returned true */
+        void count_transmit_error() noexcept {++_statistics.transmit_errors;}
         
         /* RX (do_receive => put_received) */
         /* called from the main_task, this is where the derived class should handle fragment parsing, 
         returns the number of bytes to be processed at exit */
         virtual bytes::size_type do_receive() noexcept = 0;
+        /* call when data is received outside of main_task (another thread or an interrupt) */
+        void notify_work() noexcept
+        {
+            if (_wakeup)
+                _wakeup->notify();
+        }
+
         /* can be called from do_receive */
         void put_received(fragment && p) noexcept
         {
+            /* the subscribers (fragmentation, services) run within the emit, the scope covers them */
+            SP_TRACE_SCOPE("put_received", p.object_id());
             if (p.destination() == _address)
-                receive_event.emit(std::move(p));
+            {
+                /* the batch subscribers (fragmentation) get it as a batch of one */
+                if (!receive_batch_event.empty())
+                    _emit_ours(std::span<fragment>(&p, 1));
+                else
+                    receive_event.emit(std::move(p));
+            }
             else if (p.destination() == _broadcast_address)
                 broadcast_receive_event.emit(std::move(p));
             else
                 other_receive_event.emit(std::move(p));
         }
 
+        /* can be called from do_receive with all the fragments received in one pass, the batch is 
+        left in a moved-from state. The fragments are dispatched in the order they were received, 
+        each run of consecutive fragments addressed to us is emitted as a single batch */
+        void put_received(std::span<fragment> batch) noexcept
+        {
+            if (batch.empty())
+                return;
+            if (receive_batch_event.empty())
+            {
+                for (auto & p : batch)
+                    put_received(std::move(p));
+                return;
+            }
+
+            SP_TRACE_SCOPE("put_received_batch", batch.size());
+            auto run = batch.begin();
+            for (auto it = batch.begin(); it != batch.end(); ++it)
+            {
+                if (it->destination() == _address)
+                    continue;
+                if (run != it)
+                    _emit_ours(std::span<fragment>(run, it));
+                put_received(std::move(*it));
+                run = it + 1;
+            }
+            if (run != batch.end())
+                _emit_ours(std::span<fragment>(run, batch.end()));
+        }
+
         private:
 
-        std::queue<serialized> _tx_queue;
+        /* fragments addressed to us while the batch has subscribers */
+        void _emit_ours(std::span<fragment> ours) noexcept
+        {
+            if (!receive_event.empty())
+                for (auto & p : ours)
+                    receive_event.emit(fragment(p));
+            receive_batch_event.emit(fragment_batch(ours));
+        }
+
+        std::queue<fragment> _tx_queue;
+        /* serialized front of the _tx_queue waiting for do_transmit to succeed */
+        bytes _tx_serialized;
         uint _max_queue_size;
         interface_identifier _interface_id;
         address_type _address, _broadcast_address;
+        wakeup * _wakeup = nullptr;
+        statistics _statistics;
     };
 
 }
@@ -23,6 +23,7 @@
 #define _SP_INTERFACE_INTERFACE_ID
 
 #include <cinttypes>
+#include <cstddef>
 
 #ifndef SP_NO_IOSTREAM
 #include <iostream>
@@ -40,6 +41,8 @@ namespace sp
             LOOPBACK,
             UART,
         };
+        /* number of identifier_type values, keep in sync with the enum above */
+        static constexpr std::size_t identifier_count = UART + 1;
 
         constexpr interface_identifier(identifier_type id, instance_type inst) :
             identifier(id), instance(inst) {}
@@ -32,6 +32,8 @@
 #include <errno.h> // Error integer and strerror() function
 #include <termios.h> // Contains POSIX terminal control definitions
 #include <unistd.h> // write(), read(), close()
+#include <sys/ioctl.h> // TCGETS2, TIOCGSERIAL
+#include <linux/serial.h> // serial_struct, ASYNC_LOW_LATENCY
 
 #include <stdexcept>
 
@@ -54,10 +56,28 @@ class uart_interface : public buffered_parser_interface<Header, Footer>
         std::string _m;
     };
 
+    struct serial_config
+    {
+        /* in bits per second, any rate the driver can generate, not only the Bxxxx ones */
+        uint baudrate = 115200;
+        /* RTS/CTS hardware flow control */
+        bool flow_control = false;
+        /* asks the driver to pass the received bytes on right away, USB adapters
+        otherwise hold them back for their latency timer (16 ms on FTDI) */
+        bool low_latency = true;
+    };
+
+    uart_interface(std::string port, serial_config config, interface_identifier::instance_type instance, interface::address_type address, 
+        interface::address_type broadcast_address, uint max_queue_size, uint max_fragment_size, uint buffer_size):
+            uart_interface(std::move(port), B115200, instance, address, broadcast_address, max_queue_size, max_fragment_size, buffer_size)
+    {
+        configure(config);
+    }
+
     uart_interface(std::string port, speed_t baud, interface_identifier::instance_type instance, interface::address_type address, 
         interface::address_type broadcast_address, uint max_queue_size, uint max_fragment_size, uint buffer_size):
             parent(interface_identifier(interface_identifier::identifier_type::UART, instance), address, broadcast_address,
-            max_queue_size, buffer_size, max_fragment_size)
+            max_queue_size, buffer_size, max_fragment_size), _tx_buffer(max_fragment_size)
     {
         if(!uart_open(port.c_str(), baud, 0)) 
             throw open_failed();
@@ -110,15 +130,66 @@ class uart_interface : public buffered_parser_interface<Header, Footer>
         printf("Port closed.\n");
     }
 
+    int native_handle() const noexcept {return uartFd;}
+
+    /* applies config to the open port, throws open_failed when the baudrate or the flow
+    control is refused, returns false when low_latency was requested but the driver does
+    not support it (ptys and some USB adapters), which is not an error */
+    bool configure(const serial_config & config)
+    {
+        /* termios2 lets the baudrate be any number, the classic termios only takes the
+        Bxxxx constants, the struct is declared here because <asm/termbits.h> clashes 
+        with <termios.h> */
+        struct kernel_termios2
+        {
+            tcflag_t c_iflag, c_oflag, c_cflag, c_lflag;
+            cc_t c_line;
+            cc_t c_cc[19];
+            speed_t c_ispeed, c_ospeed;
+        } tty;
+        constexpr tcflag_t bother = 0010000, cibaud = CBAUD << 16;
+        constexpr unsigned long get = _IOR('T', 0x2A, kernel_termios2);
+        constexpr unsigned long set = _IOW('T', 0x2B, kernel_termios2);
+
+        if (ioctl(uartFd, get, &tty) != 0)
+            throw open_failed("TCGETS2: " + std::string(strerror(errno)));
+        /* the input rate follows the output rate when its bits are left at zero */
+        tty.c_cflag &= ~(CBAUD | cibaud);
+        tty.c_cflag |= bother;
+        tty.c_ispeed = tty.c_ospeed = config.baudrate;
+        if (config.flow_control)
+            tty.c_cflag |= CRTSCTS;
+        else
+            tty.c_cflag &= ~CRTSCTS;
+        if (ioctl(uartFd, set, &tty) != 0)
+            throw open_failed("TCSETS2: " + std::string(strerror(errno)));
+
+        serial_struct serial;
+        if (ioctl(uartFd, TIOCGSERIAL, &serial) != 0)
+            return !config.low_latency;
+        if (config.low_latency)
+            serial.flags |= ASYNC_LOW_LATENCY;
+        else
+            serial.flags &= ~ASYNC_LOW_LATENCY;
+        return ioctl(uartFd, TIOCSSERIAL, &serial) == 0 || !config.low_latency;
+    }
+
     protected:
 
-    bool can_transmit() noexcept {return true;}
+    bool can_transmit() const noexcept {return true;}
     bool do_transmit(bytes && buff) noexcept 
     {
         //write(_serial_port, buff.data(), buff.size());
         uart_write(buff.data(), buff.size());
         return true;
     }
+    /* serializes into the staging buffer, which every fragment reuses, and writes it out */
+    bool transmit_fragment(fragment & p) noexcept
+    {
+        auto size = this->serialize_into(p, _tx_buffer.data());
+        uart_write(_tx_buffer.data(), size);
+        return true;
+    }
     void do_single_receive() 
     {
         uint8_t read_buf[8];
@@ -228,6 +299,8 @@ class uart_interface : public buffered_parser_interface<Header, Footer>
     }
 
     int uartFd;
+    /* staging area for a single serialized fragment */
+    bytes _tx_buffer;
 };
 }
 }
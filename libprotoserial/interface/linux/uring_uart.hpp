@@ -0,0 +1,186 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+/*
+ * UART interface which does its I/O through an io_ring shared with other
+ * interfaces, instead of issuing its own read and write syscalls
+ *
+ * - a read is kept in flight at all times, straight into the free part of the
+ *   receive ring buffer, the tty is switched to VMIN = 1 so that the read only
+ *   completes once there is data
+ * - fragments are serialized into the TX buffer and written by the ring, the
+ *   next fragment is taken from the queue once the write has completed
+ *
+ * the ring's main_task must be called along with the interface's, it is the
+ * one place where the syscalls happen for all the interfaces that share it.
+ */
+
+#ifndef _SP_INTERFACE_LINUX_URING_UART
+#define _SP_INTERFACE_LINUX_URING_UART
+
+#include "libprotoserial/interface/linux/uart.hpp"
+#include "libprotoserial/utils/io_ring.hpp"
+
+namespace sp
+{
+namespace detail
+{
+namespace pc
+{
+template<class Header, class Footer>
+class uring_uart_interface : public uart_interface<Header, Footer>
+{
+    using parent = uart_interface<Header, Footer>;
+
+    public:
+
+    using typename parent::serial_config;
+
+    uring_uart_interface(io_ring & ring, std::string port, speed_t baud, interface_identifier::instance_type instance,
+        interface::address_type address, interface::address_type broadcast_address, uint max_queue_size,
+        uint max_fragment_size, uint buffer_size):
+            parent(std::move(port), baud, instance, address, broadcast_address, max_queue_size, max_fragment_size, buffer_size),
+            _ring(ring)
+    {
+        _init();
+    }
+
+    uring_uart_interface(io_ring & ring, std::string port, serial_config config, interface_identifier::instance_type instance,
+        interface::address_type address, interface::address_type broadcast_address, uint max_queue_size,
+        uint max_fragment_size, uint buffer_size):
+            parent(std::move(port), config, instance, address, broadcast_address, max_queue_size, max_fragment_size, buffer_size),
+            _ring(ring)
+    {
+        _init();
+    }
+
+    /* the operations refer to our buffers, they must be gone before the buffers are */
+    ~uring_uart_interface()
+    {
+        /* the callbacks of the cancelled operations must not queue new ones */
+        _closing = true;
+        _ring.cancel(_rx_op);
+        _ring.cancel(_tx_op);
+    }
+
+    /* the ring's file descriptor, it becomes readable once an operation completes */
+    int native_handle() const noexcept {return _ring.native_handle();}
+
+    protected:
+
+    bool can_transmit() const noexcept {return !_tx_op.pending;}
+
+    bool do_transmit(bytes && buff) noexcept
+    {
+        if (_tx_op.pending || buff.size() > this->_tx_buffer.size())
+            return false;
+        std::copy(buff.begin(), buff.end(), this->_tx_buffer.begin());
+        _write(buff.size());
+        return true;
+    }
+
+    bool transmit_fragment(fragment & p) noexcept
+    {
+        if (_tx_op.pending)
+            return false;
+        _write(this->serialize_into(p, this->_tx_buffer.data()));
+        return true;
+    }
+
+    /* the data was already placed into the receive buffer by the ring, only rearm the read
+    in case the last one failed */
+    void do_single_receive()
+    {
+        if (!_rx_op.pending)
+            _read();
+    }
+
+    private:
+
+    void _init()
+    {
+        /* tcsetattr leaves the termios2 rate set by the parent alone */
+        termios tty;
+        if (tcgetattr(this->uartFd, &tty) == 0)
+        {
+            tty.c_cc[VMIN] = 1;
+            tty.c_cc[VTIME] = 0;
+            tcsetattr(this->uartFd, TCSANOW, &tty);
+        }
+        _rx_op.callback = decltype(_rx_op.callback)::template bind<&uring_uart_interface::_read_done>(this);
+        _tx_op.callback = decltype(_tx_op.callback)::template bind<&uring_uart_interface::_write_done>(this);
+        _read();
+    }
+
+    void _read()
+    {
+        auto region = this->rx_buffer_contiguous();
+        _ring.read(_rx_op, this->uartFd, region.data(), region.size());
+    }
+
+    void _read_done(int res)
+    {
+        /* errors (and the cancellation from the destructor) are not retried right away,
+        do_single_receive rearms the read on the next do_receive */
+        if (res > 0)
+        {
+            this->rx_buffer_commit(res);
+            this->notify_work();
+            if (!_closing)
+                _read();
+        }
+    }
+
+    void _write(bytes::size_type size)
+    {
+        _tx_size = size;
+        _tx_written = 0;
+        _ring.write(_tx_op, this->uartFd, this->_tx_buffer.data(), size);
+    }
+
+    void _write_done(int res)
+    {
+        if (_closing)
+            return;
+        if (res > 0)
+            _tx_written += res;
+        else if (res == 0 || (res != -EAGAIN && res != -EINTR))
+        {
+            /* the fragment is lost (a write of nothing would only repeat itself), the layers above
+            retransmit, the operation is no longer pending so main_task takes the next fragment */
+            this->count_transmit_error();
+            return;
+        }
+        /* short write, the rest is written by another operation */
+        if (_tx_written < _tx_size)
+            _ring.write(_tx_op, this->uartFd, this->_tx_buffer.data() + _tx_written, _tx_size - _tx_written);
+    }
+
+    io_ring & _ring;
+    io_ring::operation _rx_op, _tx_op;
+    bytes::size_type _tx_size = 0, _tx_written = 0;
+    bool _closing = false;
+};
+}
+}
+} // namespace sp
+
+#endif
@@ -23,6 +23,7 @@
 #define _SP_INTERFACE_PARSERS
 
 #include "libprotoserial/interface/buffered.hpp"
+#include "libprotoserial/utils/trace.hpp"
 
 #include <stdexcept>
 
@@ -41,6 +42,7 @@ namespace sp
         template<typename header, typename footer>
         fragment parse_fragment(bytes && buff, const interface & i)
         {
+            SP_TRACE_SCOPE("parse_fragment", buff.size());
             bytes b = buff;
             /* copy the header into the header struct */
             header h;
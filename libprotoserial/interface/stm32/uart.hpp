@@ -25,6 +25,7 @@
 #include "libprotoserial/interface/buffered.hpp"
 
 #include <memory>
+#include <algorithm>
 
 namespace sp
 {
@@ -32,6 +33,13 @@ namespace detail
 {
 namespace stm32
 {
+	/* transmit is double buffered, while DMA sends one serialized fragment the main_task can 
+	 * serialize the next one into the other buffer. The TX complete interrupt starts the waiting 
+	 * buffer right away, so back-to-back fragments keep the line busy no matter how long the main 
+	 * loop takes to come around, as long as it refills a buffer within one fragment's time.
+	 * 
+	 * call isr_tx_done from HAL_UART_TxCpltCallback and isr_rx_done from HAL_UART_RxCpltCallback
+	 */
 	template<class Header, class Footer>
 	class uart_interface : public buffered_parser_interface<Header, Footer>
 	{
@@ -50,21 +58,31 @@ namespace stm32
 		uart_interface(UART_HandleTypeDef * huart, interface_identifier::instance_type instance, interface::address_type address, 
 			interface::address_type broadcast_address, uint max_queue_size, uint max_fragment_size, uint buffer_size) :
 				parent(interface_identifier(interface_identifier::identifier_type::UART, instance), address, broadcast_address, 
-				max_queue_size, buffer_size, max_fragment_size), _huart(huart), _is_transmitting(false)
+				max_queue_size, buffer_size, max_fragment_size), _tx{tx_slot(max_fragment_size), tx_slot(max_fragment_size)}, 
+				_huart(huart), _tx_fill(0), _tx_active(0), _is_transmitting(false)
 		{
 			next_receive();
 		}
 
-		bool can_transmit() noexcept {return !_is_transmitting;}
+		/* true while there is a free buffer to serialize the next fragment into */
+		bool can_transmit() const noexcept {return _tx[_tx_fill].size == 0;}
+		/* true while a DMA transmit is running */
+		bool is_transmitting() const noexcept {return _is_transmitting;}
 
 		inline volatile void isr_rx_done()
 		{
 			next_receive();
 		}
 
+		/* chains the other buffer if main_task has filled it in the meantime */
 		inline volatile void isr_tx_done()
 		{
-			_is_transmitting = false;
+			_tx[_tx_active].size = 0;
+			auto next = _tx_active ^ 1;
+			if (_tx[next].size != 0)
+				start_transmit(next);
+			else
+				_is_transmitting = false;
 		}
 
 		protected:
@@ -77,20 +95,67 @@ namespace stm32
 
 		bool do_transmit(bytes && buff) noexcept
 		{
-			if (_is_transmitting)
+			if (!can_transmit() || buff.size() > _tx[_tx_fill].buffer.size())
 				return false;
 
-			_is_transmitting = true;
-			_tx_buffer = std::move(buff);
-			HAL_UART_Transmit_IT(_huart, reinterpret_cast<uint8_t*>(_tx_buffer.data()),
-					_tx_buffer.size());
+			std::copy(buff.begin(), buff.end(), _tx[_tx_fill].buffer.begin());
+			queue_transmit(buff.size());
+			return true;
+		}
+
+		/* the fragment is serialized straight into the free buffer, the buffers are filled and sent 
+		in alternating order, so _tx_fill is always the one that was sent the longest time ago */
+		bool transmit_fragment(fragment & p) noexcept
+		{
+			if (!can_transmit())
+				return false;
 
+			queue_transmit(this->serialize_into(p, _tx[_tx_fill].buffer.data()));
 			return true;
 		}
 
+		inline void queue_transmit(bytes::size_type size)
+		{
+			auto slot = _tx_fill;
+			_tx_fill = slot ^ 1;
+			/* the TX complete interrupt must not run between publishing the buffer and checking whether
+			DMA is idle, it would not see the buffer and we would not start it */
+			__disable_irq();
+			_tx[slot].size = size;
+			if (!_is_transmitting)
+				start_transmit(slot);
+			__enable_irq();
+		}
+
+		/* when the HAL refuses the transmit (HAL_BUSY, HAL_ERROR) no TX complete interrupt follows,
+		the fragment is dropped and the slot freed right away, otherwise transmit would stall for good */
+		inline void start_transmit(std::uint8_t slot)
+		{
+			_is_transmitting = true;
+			_tx_active = slot;
+			if (HAL_UART_Transmit_DMA(_huart, reinterpret_cast<uint8_t*>(_tx[slot].buffer.data()), _tx[slot].size) != HAL_OK)
+			{
+				_tx[slot].size = 0;
+				_is_transmitting = false;
+				this->count_transmit_error();
+			}
+		}
+
 		private:
-		bytes _tx_buffer;
+		struct tx_slot
+		{
+			tx_slot(uint max_fragment_size) : buffer(max_fragment_size), size(0) {}
+
+			/* holds a single serialized fragment, max_fragment_size is the serialized size limit */
+			bytes buffer;
+			/* number of serialized bytes waiting for or being transmitted, 0 when the buffer is free */
+			volatile bytes::size_type size;
+		};
+
+		tx_slot _tx[2];
 		UART_HandleTypeDef * _huart;
+		/* buffer the main_task fills next and buffer the DMA is sending */
+		volatile std::uint8_t _tx_fill, _tx_active;
 		volatile bool _is_transmitting;
 	};
 }
@@ -44,7 +44,7 @@ namespace stm32
 
 
 		bytes::size_type max_data_size() const noexcept {return _max_fragment_size - sizeof(header) - sizeof(footer);}
-		bool can_transmit() noexcept
+		bool can_transmit() const noexcept
 		{
 			return true; //TODO
 		}
@@ -56,7 +56,7 @@ namespace sp
 
             protected:
 
-            bool can_transmit() noexcept {return true;}
+            bool can_transmit() const noexcept {return true;}
             void write_failed(std::exception & e) 
             {
 #ifdef SP_LOOPBACK_WARNING
@@ -63,6 +63,7 @@ namespace sp
             {
                 for (auto & b : data)
                     this->put_single_received(b);
+                this->notify_work();
             }
 
             void put_single_serialized(byte b)
@@ -77,7 +78,7 @@ namespace sp
 
             protected:
 
-            bool can_transmit() noexcept {return true;}
+            bool can_transmit() const noexcept {return true;}
             bool do_transmit(bytes && buff) noexcept 
             {
                 _serialized.push(std::move(buff));
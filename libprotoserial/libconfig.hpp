@@ -36,5 +36,17 @@
 #define SP_LINUX
 #endif
 
+/* multithreaded use of the library (executors, thread-safe subjects) is enabled on
+platforms with std::thread, define SP_NO_THREADS to opt out */
+#if defined(SP_LINUX) && !defined(SP_NO_THREADS)
+#define SP_THREADS
+#endif
+
+/* define SP_IO_URING to make the io_uring based interfaces (sp::io_ring, sp::uring_uart_interface)
+available on Linux, they need <linux/io_uring.h> from the kernel headers (5.1 and newer) */
+
+/* define SP_NO_TIMESTAMPS to leave the creation timestamp out of the fragment and
+transfer metadata, this saves the clock read and 8 bytes per object */
+
 #endif
 
@@ -30,7 +30,7 @@ namespace sp
     struct packet_metadata : public transfer_metadata
     {
         /* as with interface::address_type this is a type that can hold all used port_type types */
-        using port_type = uint;
+        using port_type = std::uint16_t;
 
         packet_metadata(address_type src, address_type dst, interface_identifier iid, time_point timestamp_creation, 
             id_type id, id_type prev_id, port_type src_port, port_type dst_port) :
@@ -47,7 +47,7 @@ namespace sp
         packet_metadata create_response()
         {
             return packet_metadata(destination(), source(), interface_id(), 
-                clock::now(), global_id_factory.new_id(interface_id()), get_id(), 
+                fragment_metadata::stamp(), global_id_factory.new_id(interface_id()), get_id(), 
                 destination_port(), source_port()
             );
         }
@@ -34,7 +34,8 @@
 #include "libprotoserial/ports/packet.hpp"
 
 #include <list>
-#include <algorithm>
+#include <array>
+#include <vector>
 #include <stdexcept>
 
 #ifndef SP_NO_IOSTREAM
@@ -112,23 +113,33 @@ namespace sp
             interface_identifier _interface_identifier;
         };
 
+        /* every port the header can address has its slot in the service table */
+        static constexpr std::size_t port_count = std::size_t(1) << (8 * sizeof(Header::port_type));
+
         private:
 
+        /* the endpoints live in the lists so that the references handed out by register_* stay
+        valid, the tables only point into them so that routing a packet is a single indexed load */
         std::list<service_endpoint> _services;
         std::list<interface_endpoint> _interfaces;
+        std::array<service_endpoint*, port_count> _service_table = {};
+        std::vector<interface_endpoint*> _interface_table;
+
+        /* interfaces are numbered from 0 within their identifier, so the table stays small */
+        static std::size_t _interface_index(interface_identifier iid) noexcept
+        {
+            return (std::size_t)iid.instance * interface_identifier::identifier_count + iid.identifier;
+        }
 
-        auto _find_service(port_type port)
+        service_endpoint * _find_service(port_type port) const noexcept
         {
-            return std::find_if(_services.begin(), _services.end(), [&](const auto & pw){
-                return pw.get_port() == port;
-            });
+            return port < port_count ? _service_table[port] : nullptr;
         }
 
-        auto _find_interface(interface_identifier iid)
+        interface_endpoint * _find_interface(interface_identifier iid) const noexcept
         {
-            return std::find_if(_interfaces.begin(), _interfaces.end(), [&](const auto & pw){
-                return pw.get_interface_identifier() == iid;
-            });
+            auto i = _interface_index(iid);
+            return i < _interface_table.size() ? _interface_table[i] : nullptr;
         }
 
         void transfer_receive_callback(interface_identifier iid, transfer t)
@@ -138,13 +149,14 @@ namespace sp
                 Header h = parsers::byte_copy<Header>(t.data_begin());
                 if (h.is_valid())
                 {
-                    auto pw = _find_service(h.destination);
+                    auto pw = _service_table[h.destination];
                     /* just ignore ports that are not registered */
-                    if (pw != _services.end())
+                    if (pw)
                     {
+                        SP_TRACE_SCOPE("service_callback", t.object_id());
                         /* hide the header and forward the transfer to the registered service */
                         t.remove_first_n(sizeof(Header));
-                        pw->receive_event.emit(std::move(packet(std::move(t))));
+                        pw->receive_event.emit(packet(std::move(t), h));
                     }
                 }
             }
@@ -164,7 +176,7 @@ namespace sp
             p.push_front(to_bytes(h));
 
             auto i = _find_interface(p.interface_id());
-            if (i != _interfaces.end())
+            if (i)
                 i->transfer_transmit_event.emit(std::move(p.to_transfer()));
         }
 
@@ -172,27 +184,34 @@ namespace sp
         returned interface_endpoint object to a transfer factory */
         interface_endpoint & register_interface(interface_identifier iid) [[nodiscard]]
         {
-            if (_find_interface(iid) != _interfaces.end())
+            if (_find_interface(iid))
                 throw already_registered();
 
-            return _interfaces.emplace_back(iid, this);
+            auto & ie = _interfaces.emplace_back(iid, this);
+            auto i = _interface_index(iid);
+            if (i >= _interface_table.size())
+                _interface_table.resize(i + 1, nullptr);
+            _interface_table[i] = &ie;
+            return ie;
         }
 
         void register_interface(interface_identifier iid, fragmentation_handler & l)
         {
             auto & ie = register_interface(iid);
-            ie.transfer_transmit_event.subscribe(&fragmentation_handler::transmit, &l);
-            l.transfer_receive_event.subscribe(&ports_handler::interface_endpoint::transfer_receive_callback, &ie);
+            ie.transfer_transmit_event.subscribe<&fragmentation_handler::transmit>(&l);
+            l.transfer_receive_event.subscribe<&ports_handler::interface_endpoint::transfer_receive_callback>(&ie);
         }
 
         /* use this to register a new service, you must subscribe to events of interest
         within the returned service_endpoint reference */
         service_endpoint & register_port(port_type p) [[nodiscard]]
         {
-            if (_find_service(p) != _services.end())
+            if (p >= port_count)
+                throw std::out_of_range("port does not fit the header");
+            if (_find_service(p))
                 throw already_registered();
             
-            return _services.emplace_back(p, this);
+            return *(_service_table[p] = &_services.emplace_back(p, this));
         }
     };
 }
@@ -25,14 +25,241 @@
 
 #include "libprotoserial/interface.hpp"
 #include "libprotoserial/fragmentation.hpp"
+#include "libprotoserial/ports/ports.hpp"
+#include "libprotoserial/utils/wakeup.hpp"
 
 #include <chrono>
+#include <utility>
+#include <concepts>
+#include <algorithm>
 using namespace std::chrono_literals;
 
 namespace sp
 {
 namespace stack
 {
+    /* 
+     * compile-time composition of a protocol stack, the layers are listed bottom to top
+     * 
+     *   sp::stack::composed<sp::virtual_interface, my_fragmentation, sp::ports_handler> s(
+     *       [](){return sp::virtual_interface(0, 1, 255, 10, 64, 1024);},
+     *       [](auto & interface){return my_fragmentation(&interface, ...);},
+     *       [](auto & fragmentation){return sp::ports_handler();}
+     *   );
+     * 
+     * each layer is created by a factory, the first one takes no arguments, the others get
+     * a reference to the layer below them. Layers are constructed in place, so they do not 
+     * need to be movable. Adjacent layers are then connected using bind_layers(lower, upper), 
+     * which subscribes the upper layer's member functions as compile-time bound delegates, 
+     * so each hop is a single call into a stub, where the concrete callback is inlined 
+     * (declare the layer classes final to allow the compiler to devirtualize the callbacks).
+     * 
+     * bind_layers is looked up by ADL as well, provide an overload in your layer's namespace 
+     * to support custom layers. The runtime-wired bind_to/register_interface API stays 
+     * available for stacks that need to be assembled dynamically.
+     */
+
+    /* interface <-> fragmentation */
+    template<std::derived_from<interface> Interface, std::derived_from<fragmentation_handler> Fragmentation>
+    void bind_layers(Interface & i, Fragmentation & f)
+    {
+        i.receive_batch_event.template subscribe<&Fragmentation::receive_batch_callback>(&f);
+        i.transmit_began_event.template subscribe<&Fragmentation::transmit_began_callback>(&f);
+        f.transmit_event.template subscribe<&Interface::transmit>(&i);
+    }
+
+    /* fragmentation <-> ports */
+    template<std::derived_from<fragmentation_handler> Fragmentation>
+    void bind_layers(Fragmentation & f, ports_handler & p)
+    {
+        auto & ie = p.register_interface(f.interface_id());
+        ie.transfer_transmit_event.template subscribe<&Fragmentation::transmit>(&f);
+        f.transfer_receive_event.template subscribe<&ports_handler::interface_endpoint::transfer_receive_callback>(&ie);
+    }
+
+    namespace detail
+    {
+        template<std::size_t I, typename Layer>
+        struct layer_holder
+        {
+            template<typename Factory, typename Below>
+            layer_holder(Factory && f, Below * below) :
+                layer(make(std::forward<Factory>(f), below)) {}
+
+            Layer layer;
+
+            private:
+
+            template<typename Factory, typename Below>
+            static Layer make(Factory && f, Below * below)
+            {
+                if constexpr (I == 0)
+                    return std::forward<Factory>(f)();
+                else
+                    return std::forward<Factory>(f)(below->template get<I - 1>());
+            }
+        };
+
+        template<typename Indices, typename... Layers>
+        struct composed_base;
+
+        template<std::size_t... Is, typename... Layers>
+        struct composed_base<std::index_sequence<Is...>, Layers...> : layer_holder<Is, Layers>...
+        {
+            template<typename... Factories>
+            composed_base(Factories &&... f) :
+                layer_holder<Is, Layers>(std::forward<Factories>(f), this)... {}
+
+            template<std::size_t I>
+            auto & get() noexcept
+            {
+                using layer_type = std::tuple_element_t<I, std::tuple<Layers...>>;
+                return static_cast<layer_holder<I, layer_type>&>(*this).layer;
+            }
+
+            template<std::size_t I>
+            const auto & get() const noexcept
+            {
+                using layer_type = std::tuple_element_t<I, std::tuple<Layers...>>;
+                return static_cast<const layer_holder<I, layer_type>&>(*this).layer;
+            }
+        };
+    }
+
+    template<typename... Layers>
+    struct composed : detail::composed_base<std::index_sequence_for<Layers...>, Layers...>
+    {
+        static_assert(sizeof...(Layers) > 0, "a stack needs at least one layer");
+
+        using base = detail::composed_base<std::index_sequence_for<Layers...>, Layers...>;
+        static constexpr std::size_t size = sizeof...(Layers);
+
+        template<typename... Factories>
+        requires (sizeof...(Factories) == sizeof...(Layers))
+        composed(Factories &&... f) :
+            base(std::forward<Factories>(f)...)
+        {
+            _bind(std::make_index_sequence<size - 1>());
+            _connect_wakeup();
+        }
+
+        composed(const composed &) = delete;
+        composed & operator=(const composed &) = delete;
+
+        using base::get;
+        auto & bottom() noexcept {return this->template get<0>();}
+        auto & top() noexcept {return this->template get<size - 1>();}
+
+        /* calls main_task of every layer which has one, bottom to top */
+        void main_task()
+        {
+            _main_task(std::make_index_sequence<size>());
+        }
+
+        /* true when any layer has work to do right away, layers which have a main_task but do not
+        report their state (has_work or next_deadline) are assumed to always have work */
+        bool has_work() const
+        {
+            return _has_work(std::make_index_sequence<size>());
+        }
+
+        /* the earliest deadline of the layers, no_deadline() when none of them has one */
+        clock::time_point next_deadline() const
+        {
+            return _next_deadline(std::make_index_sequence<size>());
+        }
+
+        /* calls main_task until no layer has work left, at most max_rounds times,
+        returns the number of rounds run */
+        uint run_until_idle(uint max_rounds = 64)
+        {
+            uint rounds = 0;
+            while (rounds < max_rounds && (rounds == 0 || has_work()))
+            {
+                main_task();
+                ++rounds;
+            }
+            return rounds;
+        }
+
+        /* blocks until a layer has work, data arrives (fd readiness, interrupt or notify from 
+        another thread), a layer's deadline is due or timeout passes, whichever comes first.
+        Returns true when main_task should be called */
+        bool wait_for_work(clock::duration timeout)
+        {
+            auto until = clock::now() + timeout;
+            for (;;)
+            {
+                if (has_work())
+                    return true;
+                auto deadline = std::min(next_deadline(), until);
+                if (deadline <= clock::now())
+                    return deadline != until;
+                /* the layers do not see the data waiting in a watched fd before main_task reads it */
+                if (_wakeup.wait_until(deadline) && _wakeup.input_ready())
+                    return true;
+            }
+        }
+
+        /* notify() wakes up wait_for_work, for use when data is put into the stack from another thread */
+        wakeup & get_wakeup() noexcept {return _wakeup;}
+
+        private:
+
+        template<std::size_t... Is>
+        void _bind(std::index_sequence<Is...>)
+        {
+            (bind_layers(this->template get<Is>(), this->template get<Is + 1>()), ...);
+        }
+
+        template<std::size_t... Is>
+        bool _has_work(std::index_sequence<Is...>) const
+        {
+            return ([](const auto & layer){
+                if constexpr (requires {layer.has_work();})
+                    return (bool)layer.has_work();
+                else if constexpr (requires {layer.next_deadline();})
+                    return false;
+                else if constexpr (requires {layer.main_task();})
+                    return true;
+                else
+                    return false;
+            }(this->template get<Is>()) || ...);
+        }
+
+        template<std::size_t... Is>
+        clock::time_point _next_deadline(std::index_sequence<Is...>) const
+        {
+            clock::time_point deadline = no_deadline();
+            ([&](const auto & layer){
+                if constexpr (requires {layer.next_deadline();})
+                    deadline = std::min(deadline, (clock::time_point)layer.next_deadline());
+            }(this->template get<Is>()), ...);
+            return deadline;
+        }
+
+        /* the bottom layer notifies the wakeup when it receives data outside of main_task */
+        void _connect_wakeup()
+        {
+            auto & b = bottom();
+            if constexpr (requires {b.set_wakeup(&_wakeup);})
+                b.set_wakeup(&_wakeup);
+            if constexpr (requires {b.native_handle();})
+                _wakeup.watch(b.native_handle());
+        }
+
+        template<std::size_t... Is>
+        void _main_task(std::index_sequence<Is...>)
+        {
+            ([this](auto & layer){
+                if constexpr (requires {layer.main_task();})
+                    layer.main_task();
+            }(this->template get<Is>()), ...);
+        }
+
+        wakeup _wakeup;
+    };
+
     struct loopback
     {
         loopback_interface interface;
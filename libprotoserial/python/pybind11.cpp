@@ -32,8 +32,20 @@
 
 #include "libprotoserial/fragmentation.hpp"
 #include "libprotoserial/protostacks.hpp"
+#include "libprotoserial/services/built_in/link_control.hpp"
 
 #include <sstream>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <optional>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 namespace py = pybind11;
 
@@ -46,24 +58,208 @@ struct uart_115200_interface: public sp::uart_interface
 };
 
 
+/* drives a stack on a native thread, so that Python does not have to call main_task in a loop
+ * while holding the GIL. The stack is owned by the runner and is never touched by Python directly,
+ * transfers cross the thread boundary through two queues:
+ * - transmit() queues a transfer, the worker hands it to the stack on its next iteration
+ * - received transfers are collected on the worker and picked up by receive() in batches,
+ *   receive() waits with the GIL released
+ *
+ * fileno() is an eventfd which becomes readable whenever received transfers are waiting, which
+ * is what asyncio needs to await them without a thread of its own
+ *
+ *   loop.add_reader(runner.fileno(), lambda: handle(runner.receive(timeout=0)))
+ */
+template<typename Stack>
+class background_runner
+{
+    public:
+
+    template<typename... Args>
+    background_runner(std::chrono::microseconds poll_period, Args &&... args) :
+        _stack(std::forward<Args>(args)...), _poll_period(poll_period), _event_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+        if (_event_fd < 0)
+            throw std::runtime_error("eventfd failed");
+        _stack.fragmentation.transfer_receive_event.subscribe([this](sp::transfer t){
+            _received(std::move(t));
+        });
+    }
+
+    background_runner(const background_runner &) = delete;
+    background_runner & operator=(const background_runner &) = delete;
+
+    ~background_runner()
+    {
+        stop();
+        close(_event_fd);
+    }
+
+    void start()
+    {
+        if (_worker.joinable())
+            return;
+        _running = true;
+        _worker = std::thread([this]{_run();});
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard lock(_tx_mutex);
+            _running = false;
+        }
+        _tx_cv.notify_all();
+        if (_worker.joinable())
+            _worker.join();
+    }
+
+    bool running() const noexcept {return _running;}
+
+    void transmit(sp::transfer t)
+    {
+        {
+            std::lock_guard lock(_tx_mutex);
+            _tx_queue.push_back(std::move(t));
+        }
+        _tx_cv.notify_one();
+    }
+
+    /* returns up to max_count (all when 0) received transfers, waits for the first one at most
+    timeout seconds (forever when None), returns an empty list when it times out or the runner is not running */
+    std::vector<sp::transfer> receive(std::size_t max_count, std::optional<double> timeout)
+    {
+        std::vector<sp::transfer> batch;
+        std::unique_lock lock(_rx_mutex);
+        auto ready = [this]{return !_rx_queue.empty() || !_running;};
+        if (!timeout)
+            _rx_cv.wait(lock, ready);
+        else if (*timeout > 0)
+            _rx_cv.wait_for(lock, std::chrono::duration<double>(*timeout), ready);
+
+        auto count = max_count ? std::min(max_count, _rx_queue.size()) : _rx_queue.size();
+        batch.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            batch.push_back(std::move(_rx_queue.front()));
+            _rx_queue.pop_front();
+        }
+        if (_rx_queue.empty())
+        {
+            /* reading resets the eventfd counter */
+            std::uint64_t v;
+            [[maybe_unused]] auto r = read(_event_fd, &v, sizeof(v));
+        }
+        return batch;
+    }
+
+    std::size_t pending() const
+    {
+        std::lock_guard lock(_rx_mutex);
+        return _rx_queue.size();
+    }
+
+    int fileno() const noexcept {return _event_fd;}
+
+    sp::interface_identifier interface_id() const {return _stack.interface_id();}
+
+    private:
+
+    void _run()
+    {
+        std::deque<sp::transfer> tx;
+        while (true)
+        {
+            {
+                std::unique_lock lock(_tx_mutex);
+                /* nothing to send, sleep until something is or the poll period passes */
+                if (_tx_queue.empty())
+                    _tx_cv.wait_for(lock, _poll_period, [this]{return !_tx_queue.empty() || !_running;});
+                if (!_running)
+                    break;
+                tx.swap(_tx_queue);
+            }
+            for (auto & t : tx)
+                _stack.transfer_transmit(std::move(t));
+            tx.clear();
+
+            _stack.main_task();
+        }
+        /* wake up receive() calls waiting for a transfer that will never come */
+        _rx_cv.notify_all();
+    }
+
+    void _received(sp::transfer && t)
+    {
+        bool was_empty;
+        {
+            std::lock_guard lock(_rx_mutex);
+            was_empty = _rx_queue.empty();
+            _rx_queue.push_back(std::move(t));
+        }
+        if (was_empty)
+        {
+            std::uint64_t v = 1;
+            [[maybe_unused]] auto r = write(_event_fd, &v, sizeof(v));
+            _rx_cv.notify_all();
+        }
+    }
+
+    Stack _stack;
+    std::chrono::microseconds _poll_period;
+    int _event_fd;
+    std::thread _worker;
+    std::atomic<bool> _running = false;
+
+    std::mutex _tx_mutex;
+    std::condition_variable _tx_cv;
+    std::deque<sp::transfer> _tx_queue;
+
+    mutable std::mutex _rx_mutex;
+    std::condition_variable _rx_cv;
+    std::deque<sp::transfer> _rx_queue;
+};
+
+using uart_115200_runner = background_runner<sp::stack::uart_115200>;
+
 
 PYBIND11_MODULE(protoserial, m) {
-    py::class_<sp::bytes>(m, "bytesbuff")
-        .def(py::init([](py::bytes arg){
-            return sp::bytes(std::string(arg));
+    /* bytesbuff implements the buffer protocol, memoryview(b), numpy.frombuffer(b, dtype=numpy.uint8)
+    and friends share the memory with the container instead of copying it */
+    py::class_<sp::bytes>(m, "bytesbuff", py::buffer_protocol())
+        .def_buffer([](sp::bytes & b) -> py::buffer_info {
+            return py::buffer_info(b.data(), sizeof(sp::byte), py::format_descriptor<std::uint8_t>::format(),
+                1, {(py::ssize_t)b.size()}, {(py::ssize_t)sizeof(sp::byte)});
+        })
+        .def(py::init<>())
+        /* any bytes-like object (bytes, bytearray, memoryview, numpy array, ...), copied by a single memcpy */
+        .def(py::init([](py::buffer arg){
+            auto info = arg.request();
+            if (!PyBuffer_IsContiguous(info.view(), 'C'))
+                throw py::value_error("bytesbuff requires a contiguous buffer");
+            sp::bytes ret(info.size * info.itemsize);
+            if (ret.size())
+                std::memcpy(ret.data(), info.ptr, ret.size());
+            return ret;
         }))
-        .def(py::init([](std::list<int> arg){
-            sp::bytes ret(0, 0, arg.size());
-            for (auto b : arg) ret.push_back((sp::byte)b);
+        .def(py::init([](const std::vector<int> & arg){
+            sp::bytes ret(arg.size());
+            auto out = ret.data();
+            for (auto b : arg) *out++ = (sp::byte)b;
             return ret;
         }))
         .def("__repr__", [](const sp::bytes &a) {
             std::stringstream s; s << "bytesbuff(" << a << ')';
             return s.str();
         })
+        .def("__len__", &sp::bytes::size)
+        .def("as_bytes", [](const sp::bytes &arg) {
+            return py::bytes(reinterpret_cast<const char*>(arg.data()), arg.size());
+        })
         .def("as_list", [](const sp::bytes &arg) {
-            std::list<int> ret;
-            for (auto b : arg) ret.push_back((int)b);
+            py::list ret(arg.size());
+            for (sp::bytes::size_type i = 0; i < arg.size(); ++i)
+                ret[i] = (int)arg.data()[i];
             return ret;
         })
         .def("size", &sp::bytes::size);
@@ -86,7 +282,8 @@ PYBIND11_MODULE(protoserial, m) {
             return s.str();
         })
         .def(py::init<sp::fragment::address_type, sp::fragment::data_type>())
-        .def("data", [](const sp::fragment & arg) {return sp::bytes(arg.data());})
+        /* the returned bytesbuff refers to the fragment's data, it keeps the fragment alive */
+        .def("data", static_cast<sp::fragment::data_type&(sp::fragment::*)()>(&sp::fragment::data), py::return_value_policy::reference_internal)
         .def("source", &sp::fragment::source)
         .def("destination", &sp::fragment::destination)
         .def("set_destination", &sp::fragment::set_destination);
@@ -103,7 +300,8 @@ PYBIND11_MODULE(protoserial, m) {
         .def(py::init<sp::interface_identifier>())
         .def(py::init<const sp::interface &, sp::transfer::id_type>())
         .def(py::init<const sp::interface &>())
-        .def("data", &sp::transfer::data_contiguous)
+        /* zero-copy, see fragment.data() */
+        .def("data", static_cast<sp::transfer::data_type&(sp::transfer::*)()>(&sp::transfer::data), py::return_value_policy::reference_internal)
         .def("data_size", &sp::transfer::data_size)
         .def("push_back", static_cast<void(sp::transfer::*)(const sp::bytes &)>(&sp::transfer::push_back))
         //.def("push_back", [](py::bytes arg){return sp::bytes(std::string(arg));})
@@ -121,6 +319,58 @@ PYBIND11_MODULE(protoserial, m) {
             return s.str();
         });
 
+    /* durations are reported in seconds */
+    auto seconds = [](sp::clock::duration d){return std::chrono::duration<double>(d).count();};
+
+    /* register_interface connects the handler to the stack's fragmentation layer, the handler keeps 
+    the stack alive. The stack refers back to the handler, keep the handler around for as long as 
+    the stack receives */
+    py::class_<sp::ports_handler>(m, "ports_handler")
+        .def(py::init<>())
+        .def("register_interface", [](sp::ports_handler & p, sp::stack::uart_115200 & s){
+            p.register_interface(s.interface_id(), s.fragmentation);
+        }, py::keep_alive<1, 2>());
+
+    py::class_<sp::services::link_control::ping_statistics>(m, "ping_statistics")
+        .def_readonly("sent", &sp::services::link_control::ping_statistics::sent)
+        .def_readonly("received", &sp::services::link_control::ping_statistics::received)
+        .def_readonly("stale", &sp::services::link_control::ping_statistics::stale)
+        .def_property_readonly("lost", &sp::services::link_control::ping_statistics::lost)
+        .def_property_readonly("min_rtt", [=](const sp::services::link_control::ping_statistics & s){return seconds(s.min_rtt);})
+        .def_property_readonly("max_rtt", [=](const sp::services::link_control::ping_statistics & s){return seconds(s.max_rtt);})
+        .def_property_readonly("average_rtt", [=](const sp::services::link_control::ping_statistics & s){return seconds(s.average_rtt());})
+        .def_property_readonly("jitter", [=](const sp::services::link_control::ping_statistics & s){return seconds(s.jitter);});
+
+    py::class_<sp::services::link_control::bulk_statistics>(m, "bulk_statistics")
+        .def_readonly("sent", &sp::services::link_control::bulk_statistics::sent)
+        .def_readonly("sent_bytes", &sp::services::link_control::bulk_statistics::sent_bytes)
+        .def_readonly("received", &sp::services::link_control::bulk_statistics::received)
+        .def_readonly("received_bytes", &sp::services::link_control::bulk_statistics::received_bytes)
+        .def_readonly("complete", &sp::services::link_control::bulk_statistics::complete)
+        .def_property_readonly("lost", &sp::services::link_control::bulk_statistics::lost)
+        .def_property_readonly("span", [=](const sp::services::link_control::bulk_statistics & s){return seconds(s.span);})
+        .def("goodput", &sp::services::link_control::bulk_statistics::goodput);
+
+    py::class_<sp::services::link_control>(m, "link_control")
+        .def(py::init<>())
+        .def("bind_to", &sp::services::link_control::bind_to, py::keep_alive<1, 2>())
+        .def("main_task", &sp::services::link_control::main_task)
+        .def("ping", &sp::services::link_control::ping, 
+            py::arg("addr"), py::arg("iid"), py::arg("payload_size") = 0, py::arg("port") = 0)
+        .def("start_bulk", &sp::services::link_control::start_bulk, 
+            py::arg("addr"), py::arg("iid"), py::arg("count"), py::arg("payload_size"), py::arg("burst") = 1, py::arg("port") = 0)
+        .def("request_bulk_report", &sp::services::link_control::request_bulk_report)
+        .def("bulk_running", &sp::services::link_control::bulk_running)
+        .def("ping_statistics", &sp::services::link_control::get_ping_statistics)
+        .def("bulk_statistics", &sp::services::link_control::get_bulk_statistics)
+        .def("reset_ping_statistics", &sp::services::link_control::reset_ping_statistics)
+        .def("ping_response_subscribe", [=](sp::services::link_control & lc, std::function<void(double)> fn){
+            lc.ping_response_event.subscribe([=](sp::clock::duration rtt){fn(seconds(rtt));});
+        })
+        .def("bulk_complete_subscribe", [](sp::services::link_control & lc, std::function<void(sp::services::link_control::bulk_statistics)> fn){
+            lc.bulk_complete_event.subscribe([=](const sp::services::link_control::bulk_statistics & s){fn(s);});
+        });
+
     py::class_<sp::stack::uart_115200>(m, "uart_115200")
         .def(py::init<std::string, sp::interface_identifier::instance_type, sp::interface::address_type>())
         .def("main_task", &sp::stack::uart_115200::main_task)
@@ -131,6 +381,20 @@ PYBIND11_MODULE(protoserial, m) {
         .def("new_transfer", [](const sp::stack::uart_115200 & arg){
             return sp::transfer(arg.interface);
         });
+
+    py::class_<uart_115200_runner>(m, "uart_115200_runner")
+        .def(py::init([](std::string port, sp::interface_identifier::instance_type instance, sp::interface::address_type addr, double poll_period){
+            return std::make_unique<uart_115200_runner>(std::chrono::microseconds((long)(poll_period * 1e6)), port, instance, addr);
+        }), py::arg("port"), py::arg("instance"), py::arg("addr"), py::arg("poll_period") = 0.001)
+        .def("start", &uart_115200_runner::start)
+        .def("stop", &uart_115200_runner::stop, py::call_guard<py::gil_scoped_release>())
+        .def("running", &uart_115200_runner::running)
+        .def("transfer_transmit", &uart_115200_runner::transmit)
+        .def("receive", &uart_115200_runner::receive, py::call_guard<py::gil_scoped_release>(),
+            py::arg("max_count") = 0, py::arg("timeout") = py::none())
+        .def("pending", &uart_115200_runner::pending)
+        .def("fileno", &uart_115200_runner::fileno)
+        .def("interface_id", &uart_115200_runner::interface_id);
 }
 
 #endif
@@ -0,0 +1,152 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+/*
+ * the router lets a node (a gateway) bridge several buses, it listens to the
+ * other_receive_event of its interfaces, which carries the fragments that are
+ * not addressed to this node, looks up the egress interface for the fragment's
+ * destination and hands the fragment over to it.
+ *
+ * forwarding happens fragment by fragment (cut-through), transfers are never
+ * reassembled on the gateway, the fragment keeps its source and destination
+ * address and its data, only the interface header and footer are produced
+ * anew by the egress interface.
+ *
+ *   sp::router r;
+ *   r.add_interface(uart0);
+ *   r.add_interface(uart1);
+ *   r.add_route(0x20, uart1);
+ *
+ * the routing table is indexed by the destination address, so a lookup is a
+ * single indexed load. Broadcasts are not forwarded, that would need loop
+ * detection which the interface headers do not provide.
+ */
+
+#ifndef _SP_ROUTING_ROUTER
+#define _SP_ROUTING_ROUTER
+
+#include "libprotoserial/interface/interface.hpp"
+
+#include <vector>
+#include <list>
+
+namespace sp
+{
+    class router
+    {
+        public:
+
+        using address_type = interface::address_type;
+
+        struct statistics
+        {
+            uint forwarded = 0;
+            /* there was no route for the destination */
+            uint no_route = 0;
+            /* the route leads back to the bus the fragment came from */
+            uint same_interface = 0;
+            /* the egress interface refused the fragment, its queue was full or
+            the fragment does not fit its maximum data size */
+            uint rejected = 0;
+        };
+
+        router() = default;
+        router(const router &) = delete;
+        router & operator=(const router &) = delete;
+
+        ~router()
+        {
+            for (auto & i : _interfaces)
+                i.ingress->other_receive_event.unsubscribe(i.s);
+        }
+
+        /* starts forwarding the fragments received on i which are not addressed to it,
+        the interface must outlive the router */
+        void add_interface(interface & i)
+        {
+            auto & e = _interfaces.emplace_back(this, &i);
+            e.s = i.other_receive_event.subscribe<&ingress_endpoint::receive_callback>(&e);
+        }
+
+        /* fragments for dst leave through egress */
+        void add_route(address_type dst, interface & egress)
+        {
+            if (dst >= _routes.size())
+                _routes.resize(dst + 1, nullptr);
+            _routes[dst] = &egress;
+        }
+
+        void remove_route(address_type dst)
+        {
+            if (dst < _routes.size())
+                _routes[dst] = nullptr;
+        }
+
+        /* used for destinations without a route, nullptr disables it */
+        void set_default_route(interface * egress) noexcept {_default = egress;}
+
+        interface * find_route(address_type dst) const noexcept
+        {
+            return dst < _routes.size() && _routes[dst] ? _routes[dst] : _default;
+        }
+
+        const statistics & get_statistics() const noexcept {return _stats;}
+        void reset_statistics() noexcept {_stats = statistics();}
+
+        private:
+
+        struct ingress_endpoint
+        {
+            ingress_endpoint(router * r, interface * i) :
+                parent(r), ingress(i) {}
+
+            void receive_callback(fragment f)
+            {
+                parent->_forward(ingress, std::move(f));
+            }
+
+            router * parent;
+            interface * ingress;
+            subscription s;
+        };
+
+        void _forward(interface * ingress, fragment && f)
+        {
+            auto egress = find_route(f.destination());
+            if (!egress)
+                ++_stats.no_route;
+            else if (egress == ingress)
+                ++_stats.same_interface;
+            else if (egress->forward(std::move(f)))
+                ++_stats.forwarded;
+            else
+                ++_stats.rejected;
+        }
+
+        /* std::list keeps the endpoints in place, the subscriptions point to them */
+        std::list<ingress_endpoint> _interfaces;
+        std::vector<interface*> _routes;
+        interface * _default = nullptr;
+        statistics _stats;
+    };
+}
+
+#endif
@@ -0,0 +1,444 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+
+/*
+ * compile-time schema serializer, a message is described by a list of its
+ * members and the schema takes care of the wire format
+ *
+ *   struct status {std::uint8_t mode; std::int16_t temperature; std::string name; std::uint32_t uptime;};
+ *
+ *   using status_schema = sp::serializer::schema<status, 2,
+ *       sp::serializer::field<&status::mode>,
+ *       sp::serializer::field<&status::temperature>,
+ *       sp::serializer::blob_field<&status::name>,
+ *       sp::serializer::since<2, sp::serializer::field<&status::uptime>>
+ *   >;
+ *
+ *   bytes b = status_schema::to_bytes(s, interface.minimum_prealloc());
+ *   if (auto v = status_schema::parse(b))
+ *       v->get<&status::temperature>();
+ *
+ * - WIRE FORMAT: [version][field]...[field], scalars are little endian, blobs are
+ *   [length][data] where the length type is a blob_field parameter
+ * - wire_size() is constexpr, for schemas without blobs the size is known up
+ *   front as fixed_size
+ * - encoding writes straight into the (pre-allocated) storage of a bytes container
+ * - parse() validates the message and returns a view, the fields are decoded
+ *   only once they are accessed, blobs are returned as spans / string_views
+ *   into the received buffer, nothing is copied
+ * - versioning: the message carries the version of the schema that encoded it,
+ *   new fields must be appended at the end wrapped in since<version, ...>, a newer 
+ *   decoder reads the fields an older message lacks as default values and an older 
+ *   decoder ignores the fields it does not know about
+ */
+
+#ifndef _SP_SERIALIZER
+#define _SP_SERIALIZER
+
+#include "libprotoserial/data/container.hpp"
+#include "libprotoserial/data/prealloc_size.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <bit>
+#include <span>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <type_traits>
+#include <tuple>
+#include <limits>
+#include <utility>
+
+namespace sp
+{
+namespace serializer
+{
+    namespace detail
+    {
+        template<typename T>
+        struct member_pointer_traits;
+
+        template<typename Class, typename Member>
+        struct member_pointer_traits<Member Class::*>
+        {
+            using class_type = Class;
+            using member_type = Member;
+        };
+
+        template<typename T>
+        struct unsigned_of
+        {
+            using type = std::make_unsigned_t<T>;
+        };
+        template<> struct unsigned_of<bool> {using type = std::uint8_t;};
+        template<> struct unsigned_of<float> {using type = std::uint32_t;};
+        template<> struct unsigned_of<double> {using type = std::uint64_t;};
+
+        template<typename T>
+        using underlying_t = typename std::conditional_t<std::is_enum_v<T>, std::underlying_type<T>, std::type_identity<T>>::type;
+
+        /* little endian, byte by byte so that it is usable in constant expressions and independent of alignment */
+        template<typename T>
+        constexpr byte * write_scalar(T value, byte * out) noexcept
+        {
+            using U = typename unsigned_of<underlying_t<T>>::type;
+            U u;
+            if constexpr (std::is_floating_point_v<T>)
+                u = std::bit_cast<U>(value);
+            else
+                u = static_cast<U>(value);
+            for (std::size_t i = 0; i < sizeof(U); i++)
+                *out++ = static_cast<byte>(u >> (8 * i));
+            return out;
+        }
+
+        template<typename T>
+        constexpr T read_scalar(const byte * in) noexcept
+        {
+            using U = typename unsigned_of<underlying_t<T>>::type;
+            U u = 0;
+            for (std::size_t i = 0; i < sizeof(U); i++)
+                u |= static_cast<U>(static_cast<U>(in[i]) << (8 * i));
+            if constexpr (std::is_floating_point_v<T>)
+                return std::bit_cast<T>(u);
+            else
+                return static_cast<T>(u);
+        }
+
+        template<typename T>
+        constexpr bool is_scalar_v = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+    }
+
+    /* arithmetic or enum member, it takes sizeof(member) bytes on the wire */
+    template<auto Member>
+    struct field
+    {
+        using traits = detail::member_pointer_traits<decltype(Member)>;
+        using class_type = typename traits::class_type;
+        using member_type = typename traits::member_type;
+        /* what a view returns */
+        using value_type = member_type;
+
+        static_assert(detail::is_scalar_v<member_type>, "field supports arithmetic and enum members, use blob_field for the rest");
+
+        static constexpr auto member = Member;
+        static constexpr unsigned added_in = 0;
+        static constexpr bool fixed = true;
+        static constexpr std::size_t min_size = sizeof(member_type);
+
+        static constexpr std::size_t size(const class_type &) noexcept {return min_size;}
+        /* number of bytes the encoded field occupies, 0 when it does not fit into available */
+        static constexpr std::size_t encoded_size(const byte *, std::size_t available) noexcept
+        {
+            return available >= min_size ? min_size : 0;
+        }
+
+        static constexpr byte * write(const class_type & obj, byte * out) noexcept
+        {
+            return detail::write_scalar(obj.*Member, out);
+        }
+        static constexpr value_type read(const byte * in) noexcept
+        {
+            return detail::read_scalar<member_type>(in);
+        }
+        static constexpr void assign(class_type & obj, const byte * in)
+        {
+            obj.*Member = read(in);
+        }
+    };
+
+    /* variable length member (std::string, sp::bytes or any contiguous container of bytes), 
+    encoded as [Length][data], a view returns std::string_view for strings and std::span<const byte> 
+    for everything else */
+    template<auto Member, typename Length = std::uint8_t>
+    struct blob_field
+    {
+        using traits = detail::member_pointer_traits<decltype(Member)>;
+        using class_type = typename traits::class_type;
+        using member_type = typename traits::member_type;
+        static constexpr bool is_string = std::is_same_v<member_type, std::string> || std::is_same_v<member_type, std::string_view>;
+        using value_type = std::conditional_t<is_string, std::string_view, std::span<const byte>>;
+
+        static_assert(std::is_unsigned_v<Length>, "blob length must be an unsigned integer");
+
+        static constexpr auto member = Member;
+        static constexpr unsigned added_in = 0;
+        static constexpr bool fixed = false;
+        static constexpr std::size_t min_size = sizeof(Length);
+        static constexpr std::size_t max_length = std::numeric_limits<Length>::max();
+
+        /* longer blobs are truncated to max_length */
+        static constexpr std::size_t length(const class_type & obj) noexcept
+        {
+            std::size_t l = std::size(obj.*Member);
+            return l > max_length ? max_length : l;
+        }
+        static constexpr std::size_t size(const class_type & obj) noexcept {return min_size + length(obj);}
+        static constexpr std::size_t encoded_size(const byte * in, std::size_t available) noexcept
+        {
+            if (available < min_size)
+                return 0;
+            std::size_t s = min_size + detail::read_scalar<Length>(in);
+            return available >= s ? s : 0;
+        }
+
+        static constexpr byte * write(const class_type & obj, byte * out) noexcept
+        {
+            auto l = length(obj);
+            out = detail::write_scalar(static_cast<Length>(l), out);
+            auto first = std::data(obj.*Member);
+            if (std::is_constant_evaluated())
+            {
+                for (std::size_t i = 0; i < l; i++)
+                    out[i] = static_cast<byte>(first[i]);
+            }
+            else if (l)
+                std::memcpy(out, first, l);
+            return out + l;
+        }
+        static constexpr value_type read(const byte * in) noexcept
+        {
+            auto l = detail::read_scalar<Length>(in);
+            if constexpr (is_string)
+                return value_type(reinterpret_cast<const char*>(in + min_size), l);
+            else
+                return value_type(in + min_size, l);
+        }
+        static void assign(class_type & obj, const byte * in)
+        {
+            auto v = read(in);
+            if constexpr (is_string)
+                obj.*Member = member_type(v);
+            else if constexpr (std::is_same_v<member_type, bytes>)
+            {
+                obj.*Member = bytes(v.size());
+                std::copy(v.begin(), v.end(), (obj.*Member).begin());
+            }
+            else
+                obj.*Member = member_type(v.begin(), v.end());
+        }
+    };
+
+    /* field added in the given version of the schema */
+    template<unsigned Version, typename Field>
+    struct since : Field
+    {
+        static constexpr unsigned added_in = Version;
+    };
+
+    template<typename T, unsigned Version, typename... Fields>
+    struct schema
+    {
+        using value_type = T;
+        using version_type = std::uint8_t;
+
+        static constexpr unsigned version = Version;
+        static constexpr std::size_t field_count = sizeof...(Fields);
+        /* true when the wire size does not depend on the values */
+        static constexpr bool is_fixed = (Fields::fixed && ...);
+        /* wire size of a message without any blob data */
+        static constexpr std::size_t min_size = sizeof(version_type) + (Fields::min_size + ... + 0);
+
+        static_assert(Version <= std::numeric_limits<version_type>::max());
+        static_assert(((Fields::added_in <= Version) && ...), "a field cannot be newer than its schema");
+        static_assert((std::is_same_v<typename Fields::class_type, T> && ...), "all fields must be members of T");
+
+        private:
+
+        template<std::size_t I>
+        using field_at = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+        static constexpr bool _since_ordered()
+        {
+            unsigned s[] = {Fields::added_in..., Version};
+            for (std::size_t i = 1; i < sizeof(s) / sizeof(s[0]); i++)
+                if (s[i] < s[i - 1]) return false;
+            return true;
+        }
+        static_assert(_since_ordered(), "fields added in later versions must come after the older ones");
+
+        template<auto Member, std::size_t I = 0>
+        static constexpr std::size_t _index_of()
+        {
+            static_assert(I < field_count, "Member is not part of the schema");
+            if constexpr (I < field_count)
+            {
+                using F = field_at<I>;
+                if constexpr (std::is_same_v<std::remove_cv_t<decltype(F::member)>, decltype(Member)>)
+                {
+                    if constexpr (F::member == Member)
+                        return I;
+                    else
+                        return _index_of<Member, I + 1>();
+                }
+                else
+                    return _index_of<Member, I + 1>();
+            }
+            else
+                return 0;
+        }
+
+        public:
+
+        /* only defined for schemas without blobs */
+        static constexpr std::size_t fixed_size = is_fixed ? min_size : 0;
+
+        static constexpr std::size_t wire_size(const T & obj) noexcept
+        {
+            return sizeof(version_type) + (Fields::size(obj) + ... + 0);
+        }
+
+        /* writes wire_size(obj) bytes to out, returns the end of the written data */
+        static constexpr byte * encode(const T & obj, byte * out) noexcept
+        {
+            out = detail::write_scalar(static_cast<version_type>(Version), out);
+            ((out = Fields::write(obj, out)), ...);
+            return out;
+        }
+
+        /* appends the message to b, the back pre-allocation of b is used when there is enough of it */
+        static void encode(const T & obj, bytes & b)
+        {
+            auto s = b.size();
+            b.expand(0, wire_size(obj));
+            encode(obj, b.data() + s);
+        }
+
+        static bytes to_bytes(const T & obj, prealloc_size p = prealloc_size())
+        {
+            bytes b = p.create(wire_size(obj));
+            encode(obj, b.data());
+            return b;
+        }
+
+        class view
+        {
+            public:
+
+            /* version of the schema that encoded the message */
+            constexpr unsigned version() const noexcept {return detail::read_scalar<version_type>(_data);}
+
+            /* whether the message contains the field, fields newer than the message are missing */
+            template<auto Member>
+            constexpr bool has() const noexcept
+            {
+                return field_at<_index_of<Member>()>::added_in <= version();
+            }
+
+            /* decodes the field, missing fields are returned default constructed */
+            template<auto Member>
+            constexpr auto get() const noexcept
+            {
+                constexpr auto I = _index_of<Member>();
+                using F = field_at<I>;
+                if (!has<Member>())
+                    return typename F::value_type{};
+                return F::read(_data + _offset<I>());
+            }
+
+            /* copies all present fields into obj */
+            void decode_into(T & obj) const
+            {
+                _decode_into(obj, std::index_sequence_for<Fields...>());
+            }
+
+            T decode() const
+            {
+                T obj{};
+                decode_into(obj);
+                return obj;
+            }
+
+            constexpr std::span<const byte> data() const noexcept {return {_data, _size};}
+
+            private:
+            friend struct schema;
+
+            constexpr view(const byte * data, std::size_t size) noexcept :
+                _data(data), _size(size) {}
+
+            /* fields before the first blob have their offset known at compile time */
+            template<std::size_t I>
+            constexpr std::size_t _offset() const noexcept
+            {
+                if constexpr (I == 0)
+                    return sizeof(version_type);
+                else if constexpr (field_at<I - 1>::fixed)
+                    return _offset<I - 1>() + field_at<I - 1>::min_size;
+                else
+                {
+                    auto o = _offset<I - 1>();
+                    return o + field_at<I - 1>::encoded_size(_data + o, _size - o);
+                }
+            }
+
+            template<std::size_t... Is>
+            void _decode_into(T & obj, std::index_sequence<Is...>) const
+            {
+                auto v = version();
+                ((field_at<Is>::added_in <= v ? field_at<Is>::assign(obj, _data + _offset<Is>()) : void()), ...);
+            }
+
+            const byte * _data;
+            std::size_t _size;
+        };
+
+        /* checks that all fields the message should contain fit into it, the view points into data,
+        which must outlive it */
+        static constexpr std::optional<view> parse(const byte * data, std::size_t size) noexcept
+        {
+            if (size < sizeof(version_type))
+                return std::nullopt;
+
+            unsigned v = detail::read_scalar<version_type>(data);
+            std::size_t offset = sizeof(version_type);
+            bool ok = true;
+            ([&]{
+                if (!ok || Fields::added_in > v)
+                    return;
+                auto s = Fields::encoded_size(data + offset, size - offset);
+                ok = s > 0;
+                offset += s;
+            }(), ...);
+
+            if (!ok)
+                return std::nullopt;
+            return view(data, size);
+        }
+
+        static std::optional<view> parse(const bytes & b) noexcept
+        {
+            return parse(b.data(), b.size());
+        }
+
+        static std::optional<T> decode(const bytes & b)
+        {
+            if (auto v = parse(b))
+                return v->decode();
+            return std::nullopt;
+        }
+    };
+}
+}
+
+#endif
@@ -23,9 +23,12 @@
 #ifndef _SP_SERVICES_BASE
 #define _SP_SERVICES_BASE
 
-#include "libprotoserial/observer.hpp"
+#include "libprotoserial/utils/observer.hpp"
+#include "libprotoserial/utils/executor.hpp"
 #include "libprotoserial/ports/ports.hpp"
 
+#include <memory>
+
 namespace sp
 {
     /* this base class is not required for a service, it is just a "template" 
@@ -41,17 +44,35 @@ namespace sp
         void bind_to(ports_handler & l, port_type port)
         {
             auto & h = l.register_port((_port = port));
-            h.receive_event.subscribe(&port_service_base::receive_callback, this);
-            transmit_event.subscribe(&ports_handler::service_endpoint::transmit_callback, &h);
+            h.receive_event.subscribe<&port_service_base::receive_callback>(this);
+            transmit_event.subscribe<&ports_handler::service_endpoint::transmit_callback>(&h);
+        }
+
+        /* same as above, but the packets are posted into the stack's executor and receive_callback 
+        runs once the executor gets to them, so a slow service does not stall the layers below it. 
+        At most max_pending packets wait in the executor, further ones are dropped until it catches up.
+        The service must outlive the packets it has posted */
+        void bind_to(ports_handler & l, port_type port, executor & ex, uint max_pending)
+        {
+            auto & h = l.register_port((_port = port));
+            _deferred = std::make_unique<deferred_subject<packet>>(ex, max_pending);
+            _deferred->subscribe<&port_service_base::receive_callback>(this);
+            h.receive_event.subscribe([d = _deferred.get()](packet p){d->emit(std::move(p));});
+            transmit_event.subscribe<&ports_handler::service_endpoint::transmit_callback>(&h);
         }
 
         port_type get_port() const {return _port;}
 
-        
+        /* queueing statistics of a service bound to an executor, all zeros otherwise */
+        deferred_subject<packet>::statistics get_deferred_statistics() const
+        {
+            return _deferred ? _deferred->get_statistics() : deferred_subject<packet>::statistics();
+        }
 
         private:
 
         port_type _port;
+        std::unique_ptr<deferred_subject<packet>> _deferred;
     };
 }
 
@@ -20,10 +20,32 @@
  */
 
 
+/*
+ * link diagnostics, measures any stack end-to-end
+ *
+ * - ping: timestamped echo, the responder sends the request back as is, so the
+ *   round trip time is measured against the requester's own clock and the
+ *   clocks of the two nodes do not need to be synchronized. The request can be
+ *   padded to any payload size. RTT minimum/average/maximum, jitter (smoothed
+ *   difference of consecutive RTTs as in RFC 3550) and loss are collected.
+ *   A response only counts when its sequence number belongs to a ping that is
+ *   still outstanding, duplicated, late and foreign echoes are counted as stale.
+ * - bulk: sends a number of padded BULK_DATA transfers as fast as main_task
+ *   allows, then asks the receiving side how much of it arrived and over what
+ *   time span, which gives the goodput and loss of the link.
+ *
+ * MESSAGE STRUCTURE: [type][message header][padding]
+ */
+
 #ifndef _SP_SERVICES_PING
 #define _SP_SERVICES_PING
 
 #include "libprotoserial/services/base.hpp"
+#include "libprotoserial/interface/parsers.hpp"
+
+#include <list>
+#include <vector>
+#include <algorithm>
 
 namespace sp
 {
@@ -35,18 +57,174 @@ namespace services
         {
             PING_REQ = 1,
             PING_RESP,
+            BULK_DATA,
+            BULK_REPORT_REQ,
+            BULK_REPORT,
         };
 
-        void transfer_receive_callback(packet p)
+        struct __attribute__ ((__packed__)) ping_header
         {
-            message_types type = static_cast<message_types>(*p.data_begin());
-            p.remove_first_n(sizeof(message_types));
-            
-            switch (type)
+            std::uint16_t sequence;
+            /* clock::now() of the requester, only ever read back by the requester */
+            clock::rep timestamp;
+        };
+
+        struct __attribute__ ((__packed__)) bulk_header
+        {
+            std::uint16_t session;
+            std::uint32_t sequence;
+        };
+
+        struct __attribute__ ((__packed__)) bulk_report_header
+        {
+            std::uint16_t session;
+            std::uint32_t received;
+            std::uint32_t received_bytes;
+            /* time between the first and the last received BULK_DATA in microseconds */
+            std::uint32_t span_us;
+        };
+
+        public:
+
+        using address_type = interface::address_type;
+
+        /* pings older than this many requests are given up on, their responses are stale */
+        static constexpr std::size_t max_outstanding_pings = 64;
+
+        struct ping_statistics
+        {
+            uint sent = 0, received = 0;
+            /* responses which did not match an outstanding ping, not part of the other figures */
+            uint stale = 0;
+            clock::duration min_rtt = clock::duration::max(), max_rtt{0}, total_rtt{0}, jitter{0}, last_rtt{0};
+
+            /* includes the pings that are still in flight */
+            uint lost() const {return sent - received;}
+            clock::duration average_rtt() const {return received ? total_rtt / received : clock::duration{0};}
+        };
+
+        struct bulk_statistics
+        {
+            uint sent = 0, sent_bytes = 0, received = 0, received_bytes = 0;
+            /* measured by the receiving side */
+            clock::duration span{0};
+            bool complete = false;
+
+            uint lost() const {return sent - received;}
+            /* payload bytes per second as seen by the receiver */
+            double goodput() const
+            {
+                auto s = std::chrono::duration<double>(span).count();
+                return s > 0 ? received_bytes / s : 0;
+            }
+        };
+
+        /* fires with the round trip time of every ping response */
+        subject<clock::duration> ping_response_event;
+        /* fires once the report of a bulk test arrives */
+        subject<const bulk_statistics &> bulk_complete_event;
+
+        /* sends a ping request padded to payload_size bytes (if that is more than the request itself)
+        to the link_control service on addr, port 0 means the port this service is bound to */
+        void ping(address_type addr, interface_identifier iid, bytes::size_type payload_size = 0, port_type port = 0)
+        {
+            ping_header h{_ping_sequence++, clock::now().time_since_epoch().count()};
+            ++_ping.sent;
+            if (_ping_outstanding.size() == max_outstanding_pings)
+                _ping_outstanding.erase(_ping_outstanding.begin());
+            _ping_outstanding.push_back(h.sequence);
+            _send(addr, iid, port, _message(PING_REQ, h, payload_size));
+        }
+
+        /* sends count BULK_DATA transfers of payload_size bytes, at most burst per main_task call,
+        the report is requested once all of them were handed to the ports layer */
+        void start_bulk(address_type addr, interface_identifier iid, uint count, bytes::size_type payload_size, 
+            uint burst = 1, port_type port = 0)
+        {
+            _bulk_target = {addr, iid, port ? port : get_port()};
+            _bulk_remaining = count;
+            _bulk_payload = payload_size;
+            _bulk_burst = std::max(burst, 1U);
+            _bulk_sequence = 0;
+            ++_bulk_session;
+            _bulk = bulk_statistics();
+        }
+
+        /* asks the receiving side for its report again, use when the report got lost */
+        void request_bulk_report()
+        {
+            _send(_bulk_target.addr, _bulk_target.iid, _bulk_target.port, 
+                _message(BULK_REPORT_REQ, _bulk_session, 0));
+        }
+
+        bool bulk_running() const noexcept {return _bulk_remaining > 0;}
+        /* main_task only has work while a bulk test is sending */
+        bool has_work() const noexcept {return bulk_running();}
+
+        void main_task()
+        {
+            for (uint i = 0; i < _bulk_burst && _bulk_remaining; i++)
+            {
+                bulk_header h{_bulk_session, _bulk_sequence++};
+                auto m = _message(BULK_DATA, h, _bulk_payload);
+                _bulk.sent_bytes += m.size();
+                ++_bulk.sent;
+                _send(_bulk_target.addr, _bulk_target.iid, _bulk_target.port, std::move(m));
+                if (--_bulk_remaining == 0)
+                    request_bulk_report();
+            }
+        }
+
+        const ping_statistics & get_ping_statistics() const noexcept {return _ping;}
+        const bulk_statistics & get_bulk_statistics() const noexcept {return _bulk;}
+        void reset_ping_statistics() noexcept
+        {
+            _ping = ping_statistics();
+            _ping_outstanding.clear();
+        }
+
+        void receive_callback(packet p)
+        {
+            auto & data = p.data();
+            if (data.is_empty())
+                return;
+
+            switch (static_cast<message_types>(data[0]))
             {
             case message_types::PING_REQ:
-                p.push_front(to_bytes(static_cast<byte>(message_types::PING_RESP)));
-                transmit_event.emit(std::move(packet(p.create_response(), std::move(p))));
+                /* echo the request back, including the padding */
+                data[0] = static_cast<byte>(message_types::PING_RESP);
+                _reply(p);
+                break;
+
+            case message_types::PING_RESP:
+                if (data.size() >= 1 + sizeof(ping_header))
+                    _ping_response(parsers::byte_copy<ping_header>(data.begin() + 1));
+                break;
+
+            case message_types::BULK_DATA:
+                if (data.size() >= 1 + sizeof(bulk_header))
+                    _bulk_data(p, parsers::byte_copy<bulk_header>(data.begin() + 1));
+                break;
+
+            case message_types::BULK_REPORT_REQ:
+                if (data.size() >= 1 + sizeof(std::uint16_t))
+                    _bulk_report(p, parsers::byte_copy<std::uint16_t>(data.begin() + 1));
+                break;
+
+            case message_types::BULK_REPORT:
+                if (data.size() >= 1 + sizeof(bulk_report_header))
+                {
+                    auto h = parsers::byte_copy<bulk_report_header>(data.begin() + 1);
+                    if (h.session == _bulk_session)
+                    {
+                        _bulk.received = h.received;
+                        _bulk.received_bytes = h.received_bytes;
+                        _bulk.span = std::chrono::duration_cast<clock::duration>(std::chrono::microseconds(h.span_us));
+                        _bulk.complete = true;
+                        bulk_complete_event.emit(_bulk);
+                    }
+                }
                 break;
             
             default:
@@ -54,17 +232,118 @@ namespace services
             }
         }
 
+        private:
 
-        public:
+        struct target
+        {
+            address_type addr = 0;
+            interface_identifier iid;
+            port_type port = 0;
+        };
 
-        void ping(interface::address_type addr, interface_identifier iid, port_type port = 0, bytes data = bytes())
+        /* what the receiving side of a bulk test remembers about its sender */
+        struct bulk_receiver
         {
-            if (!port) 
-                port = get_port();
+            address_type addr;
+            interface_identifier iid;
+            std::uint16_t session;
+            std::uint32_t received = 0, received_bytes = 0;
+            clock::time_point first, last;
+        };
 
-            packet p()
+        template<typename Header>
+        static bytes _message(message_types type, const Header & h, bytes::size_type payload_size)
+        {
+            auto size = std::max<bytes::size_type>(payload_size, 1 + sizeof(Header));
+            bytes b(size);
+            b[0] = static_cast<byte>(type);
+            std::copy_n(reinterpret_cast<const byte*>(&h), sizeof(Header), b.begin() + 1);
+            return b;
         }
 
+        void _send(address_type addr, interface_identifier iid, port_type port, bytes && message)
+        {
+            transfer t(transfer_metadata(0, addr, iid, fragment_metadata::stamp(), global_id_factory.new_id(iid), 0), std::move(message));
+            transmit_event.emit(packet(std::move(t), get_port(), port ? port : get_port()));
+        }
+
+        void _reply(packet & request)
+        {
+            packet_metadata m = request.create_response();
+            transfer t(transfer_metadata(m), std::move(request.data()));
+            transmit_event.emit(packet(std::move(t), m.source_port(), m.destination_port()));
+        }
+
+        void _ping_response(const ping_header & h)
+        {
+            /* each sequence is accepted once, which also rules out echoes of pings sent before a reset */
+            auto it = std::find(_ping_outstanding.begin(), _ping_outstanding.end(), h.sequence);
+            if (it == _ping_outstanding.end())
+            {
+                ++_ping.stale;
+                return;
+            }
+            _ping_outstanding.erase(it);
+
+            auto rtt = clock::now().time_since_epoch() - clock::duration(h.timestamp);
+            if (_ping.received)
+            {
+                auto d = rtt > _ping.last_rtt ? rtt - _ping.last_rtt : _ping.last_rtt - rtt;
+                _ping.jitter += (d - _ping.jitter) / 16;
+            }
+            ++_ping.received;
+            _ping.last_rtt = rtt;
+            _ping.total_rtt += rtt;
+            _ping.min_rtt = std::min(_ping.min_rtt, rtt);
+            _ping.max_rtt = std::max(_ping.max_rtt, rtt);
+            ping_response_event.emit(rtt);
+        }
+
+        bulk_receiver & _find_receiver(const packet & p, std::uint16_t session)
+        {
+            auto it = std::find_if(_receivers.begin(), _receivers.end(), [&](const auto & r){
+                return r.addr == p.source() && r.iid == p.interface_id();
+            });
+            if (it == _receivers.end())
+                return _receivers.emplace_back(bulk_receiver{p.source(), p.interface_id(), session});
+            /* a new session starts from scratch */
+            if (it->session != session)
+                *it = bulk_receiver{p.source(), p.interface_id(), session};
+            return *it;
+        }
+
+        void _bulk_data(packet & p, const bulk_header & h)
+        {
+            auto & r = _find_receiver(p, h.session);
+            auto now = clock::now();
+            if (!r.received)
+                r.first = now;
+            r.last = now;
+            ++r.received;
+            r.received_bytes += p.data().size();
+        }
+
+        void _bulk_report(packet & p, std::uint16_t session)
+        {
+            auto & r = _find_receiver(p, session);
+            bulk_report_header h{session, r.received, r.received_bytes, 
+                (std::uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(r.last - r.first).count()};
+            p.data() = _message(BULK_REPORT, h, 0);
+            _reply(p);
+        }
+
+        ping_statistics _ping;
+        std::uint16_t _ping_sequence = 0;
+        std::vector<std::uint16_t> _ping_outstanding;
+
+        bulk_statistics _bulk;
+        target _bulk_target;
+        uint _bulk_remaining = 0, _bulk_burst = 1;
+        bytes::size_type _bulk_payload = 0;
+        std::uint16_t _bulk_session = 0;
+        std::uint32_t _bulk_sequence = 0;
+
+        std::list<bulk_receiver> _receivers;
     };
 }
 }
@@ -0,0 +1,290 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+/*
+ * publish/subscribe on top of ports, one producer feeds any number of local
+ * and remote subscribers of a topic
+ *
+ * - local subscribers all get a const reference to the same payload buffer,
+ *   publishing does not copy the payload for them
+ * - a remote node subscribes by sending SUBSCRIBE to the publishing node
+ *   (subscribe_remote), the publisher then sends it every PUBLISH of the topic
+ * - when a bus is registered using add_broadcast_bus and more than one remote
+ *   subscriber of the topic sits on it, a single broadcast transfer is sent
+ *   there instead of a unicast to each of them, the nodes that did not
+ *   subscribe to the topic simply drop it
+ *
+ * all nodes must bind their pubsub service to the same port, broadcasts are
+ * sent to that port.
+ *
+ * MESSAGE STRUCTURE: [type][topic][payload]
+ */
+
+
+#ifndef _SP_SERVICES_PUBSUB
+#define _SP_SERVICES_PUBSUB
+
+#include "libprotoserial/services/base.hpp"
+
+#include <list>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+namespace sp
+{
+namespace services
+{
+    class pubsub : public port_service_base
+    {
+        public:
+
+        using topic_type = std::uint8_t;
+        using address_type = interface::address_type;
+        using payload_subject = subject<const bytes &>;
+
+        static constexpr std::size_t topic_count = std::size_t(1) << (8 * sizeof(topic_type));
+
+        struct statistics
+        {
+            uint published = 0, unicasts = 0, broadcasts = 0, received = 0;
+        };
+
+        private:
+
+        enum message_types : std::uint8_t
+        {
+            SUBSCRIBE = 1,
+            UNSUBSCRIBE,
+            PUBLISH,
+        };
+
+        static constexpr bytes::size_type header_size = 2;
+
+        struct remote_subscriber
+        {
+            address_type address;
+            interface_identifier iid;
+            port_type port;
+
+            bool operator==(const remote_subscriber & other) const
+            {
+                return address == other.address && iid == other.iid && port == other.port;
+            }
+        };
+
+        struct topic
+        {
+            payload_subject local;
+            std::vector<remote_subscriber> remote;
+        };
+
+        struct broadcast_bus
+        {
+            interface_identifier iid;
+            address_type address;
+            /* scratch space of _publish_remote */
+            uint subscribers = 0;
+            bool sent = false;
+        };
+
+        public:
+
+        pubsub() = default;
+        pubsub(const pubsub &) = delete;
+        pubsub & operator=(const pubsub &) = delete;
+
+        /* fn is called with every payload published to topic t, be it locally or by another node */
+        subscription subscribe(topic_type t, payload_subject::fn_type fn)
+        {
+            return _get_topic(t).local.subscribe(std::move(fn));
+        }
+
+        void unsubscribe(topic_type t, subscription s)
+        {
+            if (_topics[t])
+                _topics[t]->local.unsubscribe(s);
+        }
+
+        /* asks the pubsub service on the node publisher to send us the topic t, the payloads are
+        delivered to the local subscribers of t */
+        void subscribe_remote(topic_type t, address_type publisher, interface_identifier iid)
+        {
+            _send(publisher, iid, get_port(), _message(SUBSCRIBE, t, bytes()));
+        }
+
+        void unsubscribe_remote(topic_type t, address_type publisher, interface_identifier iid)
+        {
+            _send(publisher, iid, get_port(), _message(UNSUBSCRIBE, t, bytes()));
+        }
+
+        /* remote subscribers on the bus iid are served by a single broadcast once there are more than one */
+        void add_broadcast_bus(interface_identifier iid, address_type broadcast_address)
+        {
+            _buses.push_back(broadcast_bus{iid, broadcast_address});
+        }
+
+        void publish(topic_type t, bytes payload)
+        {
+            auto tp = _topics[t];
+            if (!tp)
+                return;
+
+            ++_stats.published;
+            tp->local.emit(payload);
+            if (!tp->remote.empty())
+                _publish_remote(*tp, _message(PUBLISH, t, std::move(payload)));
+        }
+
+        uint remote_subscribers(topic_type t) const noexcept
+        {
+            return _topics[t] ? _topics[t]->remote.size() : 0;
+        }
+
+        const statistics & get_statistics() const noexcept {return _stats;}
+
+        void receive_callback(packet p)
+        {
+            auto & data = p.data();
+            if (data.size() < header_size)
+                return;
+
+            auto type = static_cast<message_types>(data[0]);
+            topic_type t = static_cast<topic_type>(data[1]);
+            remote_subscriber r{p.source(), p.interface_id(), p.source_port()};
+
+            switch (type)
+            {
+            case message_types::SUBSCRIBE:
+            {
+                auto & remote = _get_topic(t).remote;
+                if (std::find(remote.begin(), remote.end(), r) == remote.end())
+                    remote.push_back(r);
+                break;
+            }
+            case message_types::UNSUBSCRIBE:
+                if (_topics[t])
+                    std::erase(_topics[t]->remote, r);
+                break;
+
+            case message_types::PUBLISH:
+                /* topics nobody here subscribed to arrive through broadcasts */
+                if (_topics[t])
+                {
+                    ++_stats.received;
+                    data.shrink(header_size, 0);
+                    _topics[t]->local.emit(data);
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        private:
+
+        topic & _get_topic(topic_type t)
+        {
+            if (!_topics[t])
+                _topics[t] = &_storage.emplace_back();
+            return *_topics[t];
+        }
+
+        static bytes _message(message_types type, topic_type t, bytes payload)
+        {
+            payload.expand(header_size, 0);
+            payload[0] = static_cast<byte>(type);
+            payload[1] = static_cast<byte>(t);
+            return payload;
+        }
+
+        void _send(address_type addr, interface_identifier iid, port_type port, bytes && message)
+        {
+            transfer t(transfer_metadata(0, addr, iid, fragment_metadata::stamp(), global_id_factory.new_id(iid), 0), std::move(message));
+            transmit_event.emit(packet(std::move(t), get_port(), port));
+        }
+
+        broadcast_bus * _find_bus(interface_identifier iid)
+        {
+            auto it = std::find_if(_buses.begin(), _buses.end(), [&](const auto & b){return b.iid == iid;});
+            return it != _buses.end() ? &*it : nullptr;
+        }
+
+        void _publish_remote(const topic & tp, bytes && message)
+        {
+            for (auto & b : _buses)
+                b.subscribers = 0, b.sent = false;
+            for (auto & r : tp.remote)
+                if (auto b = _find_bus(r.iid))
+                    ++b->subscribers;
+
+            /* every transmitted transfer needs its own copy of the message, the last one takes it */
+            uint sends = 0, done = 0;
+            for (auto & r : tp.remote)
+            {
+                auto b = _find_bus(r.iid);
+                if (!b || b->subscribers < 2 || !b->sent)
+                    ++sends;
+                if (b && b->subscribers >= 2)
+                    b->sent = true;
+            }
+            for (auto & b : _buses)
+                b.sent = false;
+
+            auto send = [&](address_type addr, interface_identifier iid, port_type port){
+                if (++done == sends)
+                    _send(addr, iid, port, std::move(message));
+                else
+                    _send(addr, iid, port, bytes(message));
+            };
+
+            for (auto & r : tp.remote)
+            {
+                auto b = _find_bus(r.iid);
+                if (b && b->subscribers >= 2)
+                {
+                    if (!b->sent)
+                    {
+                        b->sent = true;
+                        ++_stats.broadcasts;
+                        send(b->address, b->iid, get_port());
+                    }
+                }
+                else
+                {
+                    ++_stats.unicasts;
+                    send(r.address, r.iid, r.port);
+                }
+            }
+        }
+
+        /* std::list keeps the topics in place, the table points into it */
+        std::list<topic> _storage;
+        std::array<topic*, topic_count> _topics = {};
+        std::vector<broadcast_bus> _buses;
+        statistics _stats;
+    };
+}
+}
+
+
+#endif
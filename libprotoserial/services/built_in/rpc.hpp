@@ -0,0 +1,249 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+/*
+ * request/response on top of ports, the response is matched to its request
+ * through the prev_id of the response (see packet_metadata::create_response)
+ *
+ * sp::services::rpc::task ask(sp::services::rpc & rpc)
+ * {
+ *     auto response = co_await rpc.call(addr, iid, port, payload, 100ms);
+ *     if (response) ...
+ *     else ... timed out
+ * }
+ *
+ * the awaiting coroutine is resumed from within receive_callback (response)
+ * or main_task (timeout), so it runs on the same thread as the rest of the
+ * stack, no threads are involved. The pending call lives in the coroutine's
+ * frame, the rpc does not allocate anything per call.
+ *
+ * the coroutine runs as part of the stack's receive path, an exception that
+ * leaves it terminates the program, catch within the coroutine. Calls still
+ * pending when the rpc is destroyed are not resumed, their coroutines are
+ * destroyed instead (which is why they must be rpc::task coroutines, nobody
+ * else owns those), so no user code runs against the dying rpc.
+ *
+ * received packets that do not answer any pending call are requests, these
+ * are emitted through request_event, answer them with respond()
+ */
+
+
+#ifndef _SP_SERVICES_RPC
+#define _SP_SERVICES_RPC
+
+#include "libprotoserial/services/base.hpp"
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <array>
+
+namespace sp
+{
+namespace services
+{
+    class rpc : public port_service_base
+    {
+        public:
+
+        using id_type = transfer_metadata::id_type;
+        using address_type = interface::address_type;
+        using result_type = std::optional<packet>;
+
+        /* minimal coroutine type for functions that co_await rpc calls, it starts right away
+        and cleans up after itself once it finishes, nobody waits for it */
+        struct task
+        {
+            struct promise_type
+            {
+                task get_return_object() noexcept {return {};}
+                std::suspend_never initial_suspend() noexcept {return {};}
+                std::suspend_never final_suspend() noexcept {return {};}
+                void return_void() noexcept {}
+                /* rethrowing would unwind into receive_callback or main_task of whoever resumed us */
+                void unhandled_exception() noexcept {std::terminate();}
+            };
+        };
+
+        class call_awaiter
+        {
+            public:
+
+            call_awaiter(rpc * r, packet && request, clock::duration timeout) :
+                _rpc(r), _request(std::move(request)), _metadata(_request),
+                _timeout(timeout) {}
+
+            call_awaiter(const call_awaiter &) = delete;
+            call_awaiter & operator=(const call_awaiter &) = delete;
+
+            bool await_ready() const noexcept {return false;}
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                _handle = h;
+                _deadline = clock::now() + _timeout;
+                _rpc->_insert(this);
+                /* the response may arrive (and resume the coroutine) before transmit returns
+                on loopback links, this must not be touched afterwards */
+                _rpc->transmit_event.emit(std::move(_request));
+            }
+
+            /* empty when the call timed out */
+            result_type await_resume() noexcept {return std::move(_response);}
+
+            private:
+            friend class rpc;
+
+            void _complete(result_type && response)
+            {
+                _response = std::move(response);
+                _handle.resume();
+            }
+
+            rpc * _rpc;
+            packet _request;
+            packet_metadata _metadata;
+            clock::duration _timeout;
+            clock::time_point _deadline;
+            std::coroutine_handle<> _handle;
+            result_type _response;
+            /* chain of calls sharing the same id slot */
+            call_awaiter * _next_in_slot = nullptr;
+            /* list of all pending calls sorted by deadline */
+            call_awaiter * _prev = nullptr, * _next = nullptr;
+        };
+
+        rpc() = default;
+        rpc(const rpc &) = delete;
+        rpc & operator=(const rpc &) = delete;
+
+        /* the coroutines of the calls that are still pending are destroyed without being resumed */
+        ~rpc()
+        {
+            while (_first)
+            {
+                auto c = _first;
+                _remove(c);
+                /* c lives in the frame */
+                auto h = c->_handle;
+                h.destroy();
+            }
+        }
+
+        /* fires for every received packet that is not a response to a pending call */
+        subject<packet> request_event;
+
+        /* sends payload to port on the node addr and waits for the response, use with co_await */
+        call_awaiter call(address_type addr, interface_identifier iid, port_type port, bytes payload, clock::duration timeout)
+        {
+            transfer t(transfer_metadata(0, addr, iid, fragment_metadata::stamp(), global_id_factory.new_id(iid), 0), std::move(payload));
+            return call_awaiter(this, packet(std::move(t), get_port(), port), timeout);
+        }
+
+        /* sends payload as the response to request */
+        void respond(packet & request, bytes payload)
+        {
+            packet_metadata m = request.create_response();
+            transfer t(transfer_metadata(m), std::move(payload));
+            transmit_event.emit(packet(std::move(t), m.source_port(), m.destination_port()));
+        }
+
+        /* completes the calls whose deadline has passed */
+        void main_task()
+        {
+            auto now = clock::now();
+            while (_first && _first->_deadline < now)
+            {
+                auto c = _first;
+                _remove(c);
+                c->_complete(std::nullopt);
+            }
+        }
+
+        /* main_task is only needed once the earliest pending call times out */
+        clock::time_point next_deadline() const noexcept {return _first ? _first->_deadline : no_deadline();}
+
+        /* number of calls waiting for a response */
+        uint pending() const noexcept {return _pending;}
+
+        void receive_callback(packet p)
+        {
+            if (p.get_prev_id())
+            {
+                for (auto c = _slots[p.get_prev_id()]; c; c = c->_next_in_slot)
+                {
+                    if (c->_metadata.match_as_response(p))
+                    {
+                        _remove(c);
+                        c->_complete(std::move(p));
+                        return;
+                    }
+                }
+            }
+            request_event.emit(std::move(p));
+        }
+
+        private:
+
+        void _insert(call_awaiter * c)
+        {
+            auto & slot = _slots[c->_metadata.get_id()];
+            c->_next_in_slot = slot;
+            slot = c;
+
+            /* calls usually share the same timeout, so walking from the back ends right away */
+            auto after = _last;
+            while (after && c->_deadline < after->_deadline)
+                after = after->_prev;
+            c->_prev = after;
+            c->_next = after ? after->_next : _first;
+            (c->_next ? c->_next->_prev : _last) = c;
+            (after ? after->_next : _first) = c;
+            ++_pending;
+        }
+
+        void _remove(call_awaiter * c)
+        {
+            for (auto s = &_slots[c->_metadata.get_id()]; *s; s = &(*s)->_next_in_slot)
+            {
+                if (*s == c)
+                {
+                    *s = c->_next_in_slot;
+                    break;
+                }
+            }
+            (c->_prev ? c->_prev->_next : _first) = c->_next;
+            (c->_next ? c->_next->_prev : _last) = c->_prev;
+            c->_prev = c->_next = c->_next_in_slot = nullptr;
+            --_pending;
+        }
+
+        /* transfer ids are issued per interface, so a slot usually holds a single call,
+        calls on different interfaces with the same id share the slot */
+        std::array<call_awaiter*, 1 << (8 * sizeof(id_type))> _slots = {};
+        call_awaiter * _first = nullptr, * _last = nullptr;
+        uint _pending = 0;
+    };
+}
+}
+
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+/*
+ * sp::atomic and sp::mutex are std::atomic and std::mutex when the library is built 
+ * with SP_THREADS, otherwise they are a plain value and a no-op with the same interface,
+ * so that single threaded targets (which may lack the instructions for lock-free 
+ * read-modify-write operations) do not pay for synchronization they do not need
+ */
+
+#ifndef _SP_UTILS_ATOMIC
+#define _SP_UTILS_ATOMIC
+
+#include "libprotoserial/libconfig.hpp"
+
+#include <atomic>
+
+#ifdef SP_THREADS
+#include <mutex>
+#endif
+
+namespace sp
+{
+#ifdef SP_THREADS
+
+    template<typename T>
+    using atomic = std::atomic<T>;
+
+    using mutex = std::mutex;
+
+#else
+
+    template<typename T>
+    struct atomic
+    {
+        constexpr atomic() noexcept = default;
+        constexpr atomic(T v) noexcept : _value(v) {}
+        atomic(const atomic &) = delete;
+        atomic & operator=(const atomic &) = delete;
+
+        T load(std::memory_order = std::memory_order_seq_cst) const noexcept {return _value;}
+        void store(T v, std::memory_order = std::memory_order_seq_cst) noexcept {_value = v;}
+        T exchange(T v, std::memory_order = std::memory_order_seq_cst) noexcept {T old = _value; _value = v; return old;}
+        T fetch_add(T v, std::memory_order = std::memory_order_seq_cst) noexcept {T old = _value; _value += v; return old;}
+        T fetch_sub(T v, std::memory_order = std::memory_order_seq_cst) noexcept {T old = _value; _value -= v; return old;}
+        bool compare_exchange_weak(T & expected, T desired, std::memory_order = std::memory_order_seq_cst,
+            std::memory_order = std::memory_order_seq_cst) noexcept
+        {
+            if (_value == expected)
+            {
+                _value = desired;
+                return true;
+            }
+            expected = _value;
+            return false;
+        }
+        bool compare_exchange_strong(T & expected, T desired, std::memory_order s = std::memory_order_seq_cst,
+            std::memory_order f = std::memory_order_seq_cst) noexcept
+        {
+            return compare_exchange_weak(expected, desired, s, f);
+        }
+
+        operator T() const noexcept {return _value;}
+        T operator=(T v) noexcept {_value = v; return v;}
+        T operator++() noexcept {return ++_value;}
+        T operator--() noexcept {return --_value;}
+
+        private:
+        T _value{};
+    };
+
+    struct mutex
+    {
+        void lock() noexcept {}
+        bool try_lock() noexcept {return true;}
+        void unlock() noexcept {}
+    };
+
+#endif
+}
+
+#endif
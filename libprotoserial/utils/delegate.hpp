@@ -0,0 +1,354 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+/*
+ * delegate is a std::function replacement tailored to the subject, it stores
+ * the callable inline within a small buffer, so subscribing a member function
+ * (member function pointer + instance pointer) or a lambda with a few captures
+ * does not allocate. Calling it is a single indirect call through the stub,
+ * there is no virtual dispatch and no std::bind layer in between.
+ *
+ * callables that do not fit into the buffer (or are not nothrow movable) are
+ * still supported, they are placed on the heap as std::function would do. As with
+ * std::function, the callable must be copy constructible.
+ *
+ * when the member function is known at compile time, use
+ *   delegate<void(int)>::bind<&observer::callback>(&o)
+ * which only stores the instance pointer and lets the compiler inline the
+ * member function into the stub
+ */
+
+#ifndef _SP_UTILS_DELEGATE
+#define _SP_UTILS_DELEGATE
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <functional>
+
+namespace sp
+{
+    /* StorageSize is the size of the inline buffer, the default fits a member function 
+    pointer + instance pointer, which is two pointers wide on the common ABIs */
+    template<typename Signature, std::size_t StorageSize = 4 * sizeof(void*)>
+    class delegate;
+
+    template<typename Ret, typename... Args, std::size_t StorageSize>
+    class delegate<Ret(Args...), StorageSize>
+    {
+        public:
+
+        static constexpr std::size_t storage_size = StorageSize;
+        static constexpr std::size_t storage_align = alignof(std::max_align_t);
+
+        private:
+
+        enum class operation {move, copy, destroy};
+
+        public:
+
+        /* type in which an argument is passed to all but the last subscriber of a fan-out,
+        lvalue references are passed through, everything else is seen as a const reference */
+        template<typename T>
+        using shared_arg_type = std::conditional_t<std::is_lvalue_reference_v<T>, T, const std::remove_reference_t<T> &>;
+
+        private:
+
+        using stub_type = Ret(*)(void*, Args&&...);
+        using shared_stub_type = Ret(*)(void*, shared_arg_type<Args>...);
+        using manager_type = void(*)(operation, void*, void*);
+
+        /* std::invoke which discards the result when Ret is void */
+        template<typename F, typename... A>
+        static Ret call(F && f, A &&... a)
+        {
+            if constexpr (std::is_void_v<Ret>)
+                std::invoke(std::forward<F>(f), std::forward<A>(a)...);
+            else
+                return std::invoke(std::forward<F>(f), std::forward<A>(a)...);
+        }
+
+        /* calls f with the shared (const reference) arguments, if f cannot accept those, ie. it takes
+        an rvalue reference, it gets its own copy of the arguments instead */
+        template<typename F>
+        static Ret invoke_shared(F && f, shared_arg_type<Args>... args)
+        {
+            if constexpr (std::is_invocable_r_v<Ret, F, shared_arg_type<Args>...>)
+                return delegate::call(std::forward<F>(f), args...);
+            else
+                return delegate::call(std::forward<F>(f), copy_of<Args>(args)...);
+        }
+
+        template<typename T>
+        static std::conditional_t<std::is_lvalue_reference_v<T>, T, std::remove_cvref_t<T>> copy_of(shared_arg_type<T> a)
+        {
+            return a;
+        }
+
+        template<typename F>
+        static constexpr bool fits_inline = sizeof(F) <= storage_size &&
+            alignof(F) <= storage_align && std::is_nothrow_move_constructible_v<F>;
+
+        template<typename F>
+        struct inline_model
+        {
+            static F * get(void * s) {return std::launder(reinterpret_cast<F*>(s));}
+
+            static Ret invoke(void * s, Args&&... args)
+            {
+                return delegate::call(*get(s), std::forward<Args>(args)...);
+            }
+            static Ret invoke_shared(void * s, shared_arg_type<Args>... args)
+            {
+                return delegate::invoke_shared(*get(s), args...);
+            }
+            static void manage(operation op, void * dst, void * src)
+            {
+                if (op == operation::move)
+                {
+                    ::new (dst) F(std::move(*get(src)));
+                    get(src)->~F();
+                }
+                else if (op == operation::copy)
+                    ::new (dst) F(*get(src));
+                else
+                    get(dst)->~F();
+            }
+        };
+
+        template<typename F>
+        struct heap_model
+        {
+            static F *& get(void * s) {return *std::launder(reinterpret_cast<F**>(s));}
+
+            static Ret invoke(void * s, Args&&... args)
+            {
+                return delegate::call(*get(s), std::forward<Args>(args)...);
+            }
+            static Ret invoke_shared(void * s, shared_arg_type<Args>... args)
+            {
+                return delegate::invoke_shared(*get(s), args...);
+            }
+            static void manage(operation op, void * dst, void * src)
+            {
+                if (op == operation::move)
+                    ::new (dst) F*(get(src));
+                else if (op == operation::copy)
+                    ::new (dst) F*(new F(*get(src)));
+                else
+                    delete get(dst);
+            }
+        };
+
+        template<typename Class, typename Method>
+        struct member_model
+        {
+            Method method;
+            Class * instance;
+
+            static member_model * get(void * s) {return std::launder(reinterpret_cast<member_model*>(s));}
+
+            static Ret invoke(void * s, Args&&... args)
+            {
+                auto m = get(s);
+                return delegate::call(m->method, m->instance, std::forward<Args>(args)...);
+            }
+            static Ret invoke_shared(void * s, shared_arg_type<Args>... args)
+            {
+                auto m = get(s);
+                /* constrained, so that invoke_shared sees when the method cannot take the shared arguments */
+                return delegate::invoke_shared([m](auto &&... a) -> Ret
+                    requires std::is_invocable_v<Method, Class*, decltype(a)...> {
+                    return delegate::call(m->method, m->instance, std::forward<decltype(a)>(a)...);
+                }, args...);
+            }
+        };
+
+        template<auto Method, typename Class>
+        static Ret bound_invoke(void * s, Args&&... args)
+        {
+            return delegate::call(Method, static_cast<Class*>(*reinterpret_cast<void**>(s)), std::forward<Args>(args)...);
+        }
+        template<auto Method, typename Class>
+        static Ret bound_invoke_shared(void * s, shared_arg_type<Args>... args)
+        {
+            auto instance = static_cast<Class*>(*reinterpret_cast<void**>(s));
+            return delegate::invoke_shared([instance](auto &&... a) -> Ret
+                requires std::is_invocable_v<decltype(Method), Class*, decltype(a)...> {
+                return delegate::call(Method, instance, std::forward<decltype(a)>(a)...);
+            }, args...);
+        }
+
+        public:
+
+        delegate() noexcept = default;
+        delegate(std::nullptr_t) noexcept {}
+
+        /* any callable object that can be called with Args... */
+        template<typename F, typename = std::enable_if_t<
+            !std::is_same_v<std::decay_t<F>, delegate> && std::is_invocable_r_v<Ret, std::decay_t<F>&, Args...>>>
+        delegate(F && f)
+        {
+            using model_type = std::decay_t<F>;
+            static_assert(std::is_copy_constructible_v<model_type>, "delegate requires copy constructible callables");
+            /* an empty std::function or a null pointer results in an empty delegate */
+            if constexpr (std::is_pointer_v<std::remove_reference_t<F>> || std::is_member_pointer_v<model_type> ||
+                std::is_same_v<model_type, std::function<Ret(Args...)>>)
+            {
+                if (!f) return;
+            }
+
+            if constexpr (fits_inline<model_type>)
+            {
+                ::new (&_storage) model_type(std::forward<F>(f));
+                _stub = &inline_model<model_type>::invoke;
+                _shared_stub = &inline_model<model_type>::invoke_shared;
+                if constexpr (!std::is_trivially_copyable_v<model_type> || !std::is_trivially_destructible_v<model_type>)
+                    _manager = &inline_model<model_type>::manage;
+            }
+            else
+            {
+                ::new (&_storage) model_type*(new model_type(std::forward<F>(f)));
+                _stub = &heap_model<model_type>::invoke;
+                _shared_stub = &heap_model<model_type>::invoke_shared;
+                _manager = &heap_model<model_type>::manage;
+            }
+        }
+
+        /* member function and an instance, this never allocates */
+        template<typename Class, typename MRet, typename... MArgs>
+        delegate(MRet (Class::*method)(MArgs...), Class * instance)
+        {
+            using model_type = member_model<Class, MRet (Class::*)(MArgs...)>;
+            static_assert(fits_inline<model_type>);
+            ::new (&_storage) model_type{method, instance};
+            _stub = &model_type::invoke;
+            _shared_stub = &model_type::invoke_shared;
+        }
+
+        /* member function known at compile time, the stub is a direct call */
+        template<auto Method, typename Class>
+        static delegate bind(Class * instance) noexcept
+        {
+            delegate d;
+            ::new (&d._storage) void*(static_cast<void*>(instance));
+            d._stub = &bound_invoke<Method, Class>;
+            d._shared_stub = &bound_invoke_shared<Method, Class>;
+            return d;
+        }
+
+        delegate(const delegate & other)
+        {
+            _copy_from(other);
+        }
+        delegate & operator=(const delegate & other)
+        {
+            if (this != &other)
+            {
+                _reset();
+                _copy_from(other);
+            }
+            return *this;
+        }
+
+        delegate(delegate && other) noexcept
+        {
+            _move_from(other);
+        }
+        delegate & operator=(delegate && other) noexcept
+        {
+            if (this != &other)
+            {
+                _reset();
+                _move_from(other);
+            }
+            return *this;
+        }
+
+        ~delegate() {_reset();}
+
+        explicit operator bool() const noexcept {return _stub != nullptr;}
+
+        /* arguments are forwarded to the callable, it may move from them */
+        Ret operator()(Args... args) const
+        {
+            return _stub(&_storage, std::forward<Args>(args)...);
+        }
+
+        /* arguments are left untouched, so they can be passed on to other delegates afterwards,
+        a callable taking an argument by value receives a copy */
+        Ret call_shared(shared_arg_type<Args>... args) const
+        {
+            return _shared_stub(&_storage, args...);
+        }
+
+        private:
+
+        void _move_from(delegate & other) noexcept
+        {
+            if (other._manager)
+                other._manager(operation::move, &_storage, &other._storage);
+            else
+                _storage = other._storage;
+
+            _stub = other._stub;
+            _shared_stub = other._shared_stub;
+            _manager = other._manager;
+            other._stub = nullptr;
+            other._shared_stub = nullptr;
+            other._manager = nullptr;
+        }
+
+        void _copy_from(const delegate & other)
+        {
+            if (other._manager)
+                other._manager(operation::copy, &_storage, &other._storage);
+            else
+                _storage = other._storage;
+
+            _stub = other._stub;
+            _shared_stub = other._shared_stub;
+            _manager = other._manager;
+        }
+
+        void _reset() noexcept
+        {
+            if (_manager)
+                _manager(operation::destroy, &_storage, nullptr);
+            _stub = nullptr;
+            _shared_stub = nullptr;
+            _manager = nullptr;
+        }
+
+        struct alignas(storage_align) storage_type
+        {
+            std::byte data[storage_size];
+        };
+
+        mutable storage_type _storage;
+        stub_type _stub = nullptr;
+        shared_stub_type _shared_stub = nullptr;
+        manager_type _manager = nullptr;
+    };
+}
+
+#endif
@@ -0,0 +1,380 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+/*
+ * subject::emit calls the subscribers synchronously from within the main_task,
+ * so a slow service callback stalls the layers below it. The deferred_subject
+ * instead posts the event into an executor's bounded queue and the subscribers
+ * are called once the executor gets to it.
+ *
+ * - run_loop is a cooperative executor, call its poll() from the main loop,
+ *   this is the variant for MCUs
+ * - thread_pool (SP_THREADS only) drains the queue from its own worker threads,
+ *   note that subscribers of one subject may then be called concurrently and
+ *   out of order
+ *
+ * create one executor per stack, the queue is shared by all deferred subjects
+ * that post into it, each subject limits the number of its own pending events
+ * (max_pending) so that a single busy subject cannot starve the others.
+ * A service opts into deferred delivery of its packets by binding to the ports
+ * with port_service_base::bind_to(ports, port, executor, max_pending).
+ */
+
+#ifndef _SP_UTILS_EXECUTOR
+#define _SP_UTILS_EXECUTOR
+
+#include "libprotoserial/libconfig.hpp"
+#include "libprotoserial/clock.hpp"
+#include "libprotoserial/utils/atomic.hpp"
+#include "libprotoserial/utils/delegate.hpp"
+#include "libprotoserial/utils/observer.hpp"
+
+#include <memory>
+#include <climits>
+
+#ifdef SP_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#endif
+
+namespace sp
+{
+    /* bounded multi-producer queue (D. Vyukov's algorithm), every cell carries a sequence number
+    which tells producers and consumers whether the cell is free or holds a value, so no locks are
+    needed. capacity is rounded up to a power of two */
+    template<typename T>
+    class bounded_queue
+    {
+        struct cell
+        {
+            atomic<std::size_t> sequence;
+            alignas(T) std::byte storage[sizeof(T)];
+
+            T * get() noexcept {return std::launder(reinterpret_cast<T*>(storage));}
+        };
+
+        static std::size_t round_up(std::size_t v)
+        {
+            std::size_t r = 2;
+            while (r < v) r <<= 1;
+            return r;
+        }
+
+        public:
+
+        bounded_queue(std::size_t capacity) :
+            _mask(round_up(capacity) - 1), _cells(new cell[_mask + 1])
+        {
+            for (std::size_t i = 0; i <= _mask; i++)
+                _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        bounded_queue(const bounded_queue &) = delete;
+        bounded_queue & operator=(const bounded_queue &) = delete;
+
+        ~bounded_queue()
+        {
+            T tmp;
+            while (pop(tmp)) {}
+        }
+
+        /* returns false when the queue is full, value is left untouched in that case */
+        bool push(T && value)
+        {
+            cell * c;
+            std::size_t pos = _enqueue.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                c = &_cells[pos & _mask];
+                std::size_t seq = c->sequence.load(std::memory_order_acquire);
+                auto diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+                if (diff == 0)
+                {
+                    if (_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false;
+                else
+                    pos = _enqueue.load(std::memory_order_relaxed);
+            }
+            ::new (c->storage) T(std::move(value));
+            c->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /* returns false when the queue is empty */
+        bool pop(T & value)
+        {
+            cell * c;
+            std::size_t pos = _dequeue.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                c = &_cells[pos & _mask];
+                std::size_t seq = c->sequence.load(std::memory_order_acquire);
+                auto diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + 1);
+                if (diff == 0)
+                {
+                    if (_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false;
+                else
+                    pos = _dequeue.load(std::memory_order_relaxed);
+            }
+            value = std::move(*c->get());
+            c->get()->~T();
+            c->sequence.store(pos + _mask + 1, std::memory_order_release);
+            return true;
+        }
+
+        /* only a snapshot when used from multiple threads */
+        std::size_t size() const noexcept
+        {
+            return _enqueue.load(std::memory_order_relaxed) - _dequeue.load(std::memory_order_relaxed);
+        }
+        bool empty() const noexcept {return size() == 0;}
+        std::size_t capacity() const noexcept {return _mask + 1;}
+
+        private:
+
+        const std::size_t _mask;
+        std::unique_ptr<cell[]> _cells;
+        alignas(64) atomic<std::size_t> _enqueue{0};
+        alignas(64) atomic<std::size_t> _dequeue{0};
+    };
+
+
+    struct executor
+    {
+        /* the inline buffer fits the deferred_subject's closure with a fragment or transfer
+        argument, so posting an event does not allocate */
+        using task_type = delegate<void(), 16 * sizeof(void*)>;
+
+        virtual ~executor() {}
+
+        /* returns false when the task could not be queued */
+        virtual bool post(task_type && t) = 0;
+    };
+
+    /* cooperative executor, tasks run when poll() is called */
+    class run_loop : public executor
+    {
+        public:
+
+        run_loop(std::size_t capacity) :
+            _queue(capacity) {}
+
+        bool post(task_type && t)
+        {
+            return _queue.push(std::move(t));
+        }
+
+        /* runs up to max_tasks queued tasks, returns the number of tasks run */
+        uint poll(uint max_tasks = UINT_MAX)
+        {
+            uint count = 0;
+            task_type t;
+            while (count < max_tasks && _queue.pop(t))
+            {
+                t();
+                t = nullptr;
+                ++count;
+            }
+            return count;
+        }
+
+        bool empty() const noexcept {return _queue.empty();}
+        std::size_t size() const noexcept {return _queue.size();}
+
+        private:
+        bounded_queue<task_type> _queue;
+    };
+
+#ifdef SP_THREADS
+    /* executor backed by worker threads, the threads sleep when there is nothing to do */
+    class thread_pool : public executor
+    {
+        public:
+
+        thread_pool(uint threads, std::size_t capacity) :
+            _queue(capacity)
+        {
+            for (uint i = 0; i < threads; i++)
+                _threads.emplace_back(&thread_pool::_worker, this);
+        }
+
+        ~thread_pool()
+        {
+            {
+                std::lock_guard lock(_mutex);
+                _stop = true;
+            }
+            _cv.notify_all();
+            for (auto & t : _threads)
+                t.join();
+        }
+
+        bool post(task_type && t)
+        {
+            if (!_queue.push(std::move(t)))
+                return false;
+            /* taking the lock prevents the notification from getting lost between
+            a worker's predicate check and its wait */
+            {
+                std::lock_guard lock(_mutex);
+            }
+            _cv.notify_one();
+            return true;
+        }
+
+        std::size_t size() const noexcept {return _queue.size();}
+
+        private:
+
+        void _worker()
+        {
+            task_type t;
+            for (;;)
+            {
+                if (_queue.pop(t))
+                {
+                    t();
+                    t = nullptr;
+                    continue;
+                }
+
+                std::unique_lock lock(_mutex);
+                _cv.wait(lock, [this]{return _stop || !_queue.empty();});
+                if (_stop && _queue.empty())
+                    return;
+            }
+        }
+
+        bounded_queue<task_type> _queue;
+        std::vector<std::thread> _threads;
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        bool _stop = false;
+    };
+#endif
+
+
+    /* subject whose emit() queues the event into an executor instead of calling the subscribers
+    directly, the subscribers are called with the same fan-out rules as subject::emit once the
+    executor runs the event. The deferred_subject must outlive the events it has posted. */
+    template<typename... Args>
+    struct deferred_subject : public subject<Args...>
+    {
+        struct statistics
+        {
+            uint posted = 0, dispatched = 0, dropped = 0, pending = 0;
+            /* time between emit() and the start of the dispatch */
+            clock::duration max_latency{0}, total_latency{0};
+
+            clock::duration average_latency() const
+            {
+                return dispatched ? total_latency / dispatched : clock::duration{0};
+            }
+        };
+
+        /* at most max_pending events of this subject can wait in the executor at once,
+        further events are dropped until the executor catches up */
+        deferred_subject(executor & ex, uint max_pending) :
+            _executor(&ex), _max_pending(max_pending) {}
+
+        /* queues the event, returns false when it was dropped either because this subject
+        has max_pending events queued already or because the executor's queue is full */
+        bool emit(Args... arg)
+        {
+            if (_pending.fetch_add(1) >= _max_pending)
+            {
+                _pending.fetch_sub(1);
+                _dropped.fetch_add(1);
+                return false;
+            }
+
+            auto posted_at = clock::now();
+            bool ok = _executor->post([this, posted_at, ...a = std::move(arg)]() mutable {
+                _record_dispatch(clock::now() - posted_at);
+                subject<Args...>::emit(std::move(a)...);
+            });
+
+            if (ok)
+                _posted.fetch_add(1);
+            else
+            {
+                _pending.fetch_sub(1);
+                _dropped.fetch_add(1);
+            }
+            return ok;
+        }
+
+        /* bypasses the executor, the subscribers are called right away */
+        void emit_now(Args... arg) const
+        {
+            subject<Args...>::emit(std::forward<Args>(arg)...);
+        }
+
+        statistics get_statistics() const
+        {
+            statistics s;
+            s.posted = _posted.load();
+            s.dispatched = _dispatched.load();
+            s.dropped = _dropped.load();
+            s.pending = _pending.load();
+            s.max_latency = clock::duration{_max_latency.load()};
+            s.total_latency = clock::duration{_total_latency.load()};
+            return s;
+        }
+
+        void reset_statistics()
+        {
+            _posted.store(0);
+            _dispatched.store(0);
+            _dropped.store(0);
+            _max_latency.store(0);
+            _total_latency.store(0);
+        }
+
+        private:
+
+        void _record_dispatch(clock::duration latency)
+        {
+            auto l = latency.count();
+            _total_latency.fetch_add(l);
+            auto max = _max_latency.load();
+            while (l > max && !_max_latency.compare_exchange_weak(max, l)) {}
+            _dispatched.fetch_add(1);
+            _pending.fetch_sub(1);
+        }
+
+        executor * _executor;
+        uint _max_pending;
+        atomic<uint> _posted{0}, _dispatched{0}, _dropped{0}, _pending{0};
+        atomic<clock::rep> _max_latency{0}, _total_latency{0};
+    };
+}
+
+#endif
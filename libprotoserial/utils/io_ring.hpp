@@ -0,0 +1,277 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+/*
+ * minimal io_uring wrapper on top of the raw syscalls, so that there is no
+ * dependency on liburing. A single ring is shared by many interfaces (all the
+ * UARTs of a gateway for example), the interfaces only queue their reads and
+ * writes, main_task then submits everything that was queued and collects all
+ * the completions using a single io_uring_enter call.
+ *
+ *   sp::io_ring ring;
+ *   sp::uring_uart_interface a(ring, "/dev/ttyUSB0", ...), b(ring, "/dev/ttyUSB1", ...);
+ *   while (true)
+ *   {
+ *       ring.main_task();
+ *       a.main_task();
+ *       b.main_task();
+ *   }
+ *
+ * every queued operation refers to an io_ring::operation owned by the caller,
+ * its callback is called from main_task with the result of the operation (number
+ * of bytes or -errno). The operation must stay alive until it completes, use
+ * cancel() to get rid of it early.
+ *
+ * the ring is not thread-safe, it must be driven from the thread which runs the
+ * stacks that use it, the reactor can do that since io_ring has a main_task.
+ */
+
+#ifndef _SP_UTILS_IO_RING
+#define _SP_UTILS_IO_RING
+
+#include "libprotoserial/libconfig.hpp"
+#include "libprotoserial/utils/delegate.hpp"
+
+#ifdef SP_LINUX
+
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace sp
+{
+    class io_ring
+    {
+        public:
+
+        struct operation
+        {
+            /* called with the result of the operation, the number of bytes or -errno */
+            delegate<void(int)> callback;
+            /* true from the moment it is queued until it completes, it is cleared right before the
+            callback is called, so that the callback can queue the operation again */
+            bool pending = false;
+        };
+
+        io_ring(unsigned entries = 256)
+        {
+            io_uring_params p;
+            std::memset(&p, 0, sizeof(p));
+            _fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+            if (_fd < 0)
+                throw std::runtime_error("io_uring_setup failed");
+
+            _sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            _cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            _single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+            if (_single_mmap)
+                _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+
+            _sq_ptr = mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+            _cq_ptr = _single_mmap ? _sq_ptr :
+                mmap(nullptr, _cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+            _sqes = static_cast<io_uring_sqe*>(mmap(nullptr, p.sq_entries * sizeof(io_uring_sqe),
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+            _sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+            if (_sq_ptr == MAP_FAILED || _cq_ptr == MAP_FAILED || _sqes == MAP_FAILED)
+            {
+                _unmap();
+                close(_fd);
+                throw std::runtime_error("io_uring mmap failed");
+            }
+
+            auto sq = static_cast<char*>(_sq_ptr);
+            _sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+            _sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+            _sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+            _sq_entries = p.sq_entries;
+            _sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+            auto cq = static_cast<char*>(_cq_ptr);
+            _cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+            _cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+            _cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+            _cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        }
+
+        io_ring(const io_ring &) = delete;
+        io_ring & operator=(const io_ring &) = delete;
+
+        ~io_ring()
+        {
+            _unmap();
+            close(_fd);
+        }
+
+        void read(operation & op, int fd, void * buffer, unsigned size)
+        {
+            _queue(IORING_OP_READ, op, fd, buffer, size);
+        }
+
+        void write(operation & op, int fd, const void * buffer, unsigned size)
+        {
+            _queue(IORING_OP_WRITE, op, fd, const_cast<void*>(buffer), size);
+        }
+
+        /* requests the cancellation of op and waits until it completes, its callback
+        is called with -ECANCELED unless it managed to complete in the meantime. The
+        callback must not queue op again, cancel would wait for that one as well */
+        void cancel(operation & op)
+        {
+            if (!op.pending)
+                return;
+            auto sqe = _get_sqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = reinterpret_cast<std::uint64_t>(&op);
+            sqe->user_data = 0;
+            _push_sqe();
+            while (op.pending)
+                _enter(1);
+        }
+
+        /* submits the queued operations and calls the callbacks of the completed ones */
+        void main_task() {_enter(0);}
+        /* same as main_task but waits until at least one operation completes */
+        void wait() {_enter(1);}
+
+        /* queued operations not yet handed to the kernel */
+        bool has_work() const noexcept {return _to_submit != 0;}
+        /* becomes readable when there are completions to be collected */
+        int native_handle() const noexcept {return _fd;}
+        /* number of io_uring_enter calls so far */
+        std::uint64_t syscall_count() const noexcept {return _syscalls;}
+
+        private:
+
+        io_uring_sqe * _get_sqe()
+        {
+            /* the kernel consumes the whole submission queue in every _enter */
+            if (_to_submit == _sq_entries)
+                _enter(0);
+            auto tail = *_sq_tail;
+            auto index = tail & _sq_mask;
+            auto sqe = &_sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            _sq_array[index] = index;
+            return sqe;
+        }
+
+        /* hands the entry returned by the last _get_sqe to the kernel, once it is filled in */
+        void _push_sqe()
+        {
+            std::atomic_ref<unsigned>(*_sq_tail).fetch_add(1, std::memory_order_release);
+            ++_to_submit;
+        }
+
+        void _queue(std::uint8_t opcode, operation & op, int fd, void * buffer, unsigned size)
+        {
+            if (op.pending)
+                throw std::logic_error("io_ring operation is already pending");
+            auto sqe = _get_sqe();
+            sqe->opcode = opcode;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<std::uint64_t>(buffer);
+            sqe->len = size;
+            /* non-seekable files (ttys) ignore the offset, -1 means the current position */
+            sqe->off = (std::uint64_t)-1;
+            sqe->user_data = reinterpret_cast<std::uint64_t>(&op);
+            _push_sqe();
+            op.pending = true;
+        }
+
+        void _enter(unsigned min_complete)
+        {
+            /* nothing to submit and nothing to wait for, the completions can be collected
+            without entering the kernel */
+            if (_to_submit != 0 || min_complete != 0)
+            {
+                int ret;
+                do
+                {
+                    ret = (int)syscall(__NR_io_uring_enter, _fd, _to_submit, min_complete,
+                        min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+                    ++_syscalls;
+                } while (ret < 0 && errno == EINTR);
+                if (ret >= 0)
+                    _to_submit -= (unsigned)ret <= _to_submit ? (unsigned)ret : _to_submit;
+            }
+            _reap();
+        }
+
+        void _reap()
+        {
+            auto head = *_cq_head;
+            auto tail = std::atomic_ref<unsigned>(*_cq_tail).load(std::memory_order_acquire);
+            for (; head != tail; ++head)
+            {
+                auto & cqe = _cqes[head & _cq_mask];
+                auto op = reinterpret_cast<operation*>(cqe.user_data);
+                auto res = cqe.res;
+                /* release the slot before the callback, which may queue another operation */
+                std::atomic_ref<unsigned>(*_cq_head).store(head + 1, std::memory_order_release);
+                if (op)
+                {
+                    op->pending = false;
+                    if (op->callback)
+                        op->callback(res);
+                }
+            }
+        }
+
+        void _unmap()
+        {
+            if (_sqes && _sqes != MAP_FAILED)
+                munmap(_sqes, _sqes_size);
+            if (!_single_mmap && _cq_ptr && _cq_ptr != MAP_FAILED)
+                munmap(_cq_ptr, _cq_size);
+            if (_sq_ptr && _sq_ptr != MAP_FAILED)
+                munmap(_sq_ptr, _sq_size);
+        }
+
+        int _fd;
+        bool _single_mmap;
+        void * _sq_ptr = nullptr, * _cq_ptr = nullptr;
+        io_uring_sqe * _sqes = nullptr;
+        std::size_t _sq_size, _cq_size, _sqes_size = 0;
+
+        unsigned * _sq_head, * _sq_tail, * _sq_array;
+        unsigned _sq_mask, _sq_entries;
+        unsigned * _cq_head, * _cq_tail;
+        unsigned _cq_mask;
+        io_uring_cqe * _cqes;
+
+        unsigned _to_submit = 0;
+        std::uint64_t _syscalls = 0;
+    };
+}
+
+#endif
+
+#endif
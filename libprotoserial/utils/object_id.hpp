@@ -1,6 +1,7 @@
 
 #include "libprotoserial/libconfig.hpp"
 #include "libprotoserial/data/container.hpp"
+#include "libprotoserial/utils/atomic.hpp"
 
 namespace sp
 {
@@ -13,9 +14,9 @@ namespace sp
         sp_object() : sp_object(_new_id()) {}
 
         sp_object(const sp_object &) : sp_object() {}
-        sp_object(sp_object && obj) : sp_object(obj.object_id()) {}
+        sp_object(sp_object && obj) noexcept : sp_object(obj.object_id()) {}
         sp_object & operator=(const sp_object &) {_id = _new_id(); return *this;}
-        sp_object & operator=(sp_object && obj) {_id = obj.object_id(); return *this;}
+        sp_object & operator=(sp_object && obj) noexcept {_id = obj.object_id(); return *this;}
 
         /* this ID is tracked globally and should be unique on a modest
         time scale. All ID values are valid. Move preserves the ID but a Copy
@@ -24,12 +25,25 @@ namespace sp
 
         private:
 
-        sp_object(object_id_type id) : _id(id) {}
+        sp_object(object_id_type id) noexcept : _id(id) {}
         
         object_id_type _new_id() 
         {
-            static object_id_type _id_count = 0;
+            static atomic<object_id_type> _id_count{0};
+#ifdef SP_THREADS
+            /* threads take the IDs in blocks, so that objects created on different threads
+            (reactor workers) do not contend on the counter */
+            static constexpr object_id_type block = 1024;
+            thread_local object_id_type next = 0, last = 0;
+            if (next == last)
+            {
+                next = _id_count.fetch_add(block, std::memory_order_relaxed);
+                last = next + block;
+            }
+            return ++next;
+#else
             return ++_id_count;
+#endif
         }
 
         object_id_type _id;
@@ -44,10 +44,14 @@
 #ifndef _SP_OBSERVER
 #define _SP_OBSERVER
 
-#include <list>
+#include "libprotoserial/utils/delegate.hpp"
+#include "libprotoserial/utils/atomic.hpp"
+
+#include <vector>
 #include <algorithm>
 #include <functional>
-#include <memory>
+#include <mutex>
+#include <utility>
 
 namespace sp
 {
@@ -58,12 +62,18 @@ namespace sp
         
         static const id invalid_id = 0;
 
-        subscription() : _id((++_id_count == invalid_id) ? ++_id_count : _id_count) {}
+        subscription() : _id(_new_id()) {}
         id get_id() const {return _id;}
         
         private:
         id _id = invalid_id;
-        static id _id_count;
+        static atomic<id> _id_count;
+
+        static id _new_id() noexcept
+        {
+            id i = ++_id_count;
+            return i == invalid_id ? ++_id_count : i;
+        }
     };
 
     bool operator==(const subscription &lhs, const subscription &rhs)
@@ -71,41 +81,39 @@ namespace sp
         return lhs.get_id() == rhs.get_id();
     }
 
-    subscription::id subscription::_id_count = 0;
+    atomic<subscription::id> subscription::_id_count{0};
 
 
+    /* subscribe and unsubscribe may be called from other threads (or from within a subscriber)
+    while the subject is being emitted. Subscribers are kept in a snapshot which emit reads without 
+    taking a lock, the entries an emit can see are never modified. subscribe appends behind them 
+    while there is spare capacity and publishes the new size, otherwise (and on unsubscribe) the
+    snapshot is replaced by a modified copy (copy-on-write). 
+    
+    Replaced snapshots are retired and freed using epochs: emit registers as a reader of the current 
+    epoch (one counter per epoch parity) for as long as it holds the snapshot, the registration is 
+    undone by a scope guard, so a throwing subscriber does not leave it behind. A snapshot retired 
+    during epoch E can only be held by readers of E and earlier, the epoch is advanced once the 
+    readers of the previous one are gone, and the snapshot is freed once the readers of E are gone 
+    too. New emits register with the new epoch, so the old readers drain even when emits keep 
+    overlapping, and at most the readers of two epochs exist at any time. */
     template<typename... Args>
     struct subject
     {
-        using fn_type = std::function<void(Args...)>;
+        using fn_type = delegate<void(Args...)>;
         
         private:
-        struct fn_base 
-        {
-            virtual ~fn_base() {}
-            virtual void exec(Args... arg) {}
-            virtual void exec() {}
-            virtual bool is_subs() const = 0;
-        };
-        struct fn_subs : public fn_base
+        struct entry
         {
             fn_type fn;
-            fn_subs(fn_type f) : fn(f) {}
-            void exec(Args... arg) {fn(std::forward<Args>(arg)...);}
-            bool is_subs() const {return true;}
-        };
-        struct fn_watch : public fn_base
-        {
-            std::function<void(void)> fn;
-            fn_watch(std::function<void(void)> f) : fn(f) {}
-            void exec() {fn();}
-            bool is_subs() const {return false;}
+            subscription s;
         };
 
-        struct entry
+        struct snapshot
         {
-            std::unique_ptr<fn_base> fn;
-            subscription s;
+            /* never reallocates, size is the number of entries visible to emit */
+            std::vector<entry> entries;
+            atomic<std::size_t> size{0};
         };
 
         public:
@@ -116,60 +124,191 @@ namespace sp
         subject & operator=(const subject &) = delete;
         subject & operator=(subject &&) = delete;
 
+        /* the subject must not be emitted while it is being destroyed */
+        ~subject()
+        {
+            delete _current.load();
+            for (auto r : _retired)
+                delete r.first;
+        }
+
+        /* watchers are notified that the event happened, they do not receive the arguments */
         subscription watch(std::function<void(void)> fn)
         {
-            auto f = std::unique_ptr<fn_base>(new fn_watch(fn));
-            auto & t = _callbacks.emplace_back(std::move(f), subscription());
-            return t.s;
+            return subscribe(fn_type([f = std::move(fn)](auto &&...){f();}));
         }
 
-        template<typename Class>
-        subscription watch(void(Class::*f)(), Class *instance) {
-            return watch(std::bind(f, static_cast<Class*>(instance)));
+        template<typename Class, typename Instance>
+        subscription watch(void(Class::*f)(), Instance *instance) {
+            return subscribe(fn_type([f, i = static_cast<Class*>(instance)](auto &&...){(i->*f)();}));
         }
 
         subscription subscribe(fn_type fn)
         {
-            auto f = std::unique_ptr<fn_base>(new fn_subs(fn));
-            auto & t = _callbacks.emplace_back(std::move(f), subscription());
-            return t.s;
+            subscription s;
+            /* empty callbacks are never called, there is no need to store them */
+            if (fn)
+            {
+                std::lock_guard lock(_mutex);
+                auto current = _current.load();
+                if (current && current->entries.size() < current->entries.capacity())
+                {
+                    current->entries.emplace_back(std::move(fn), s);
+                    current->size.store(current->entries.size());
+                }
+                else
+                {
+                    auto next = new snapshot();
+                    next->entries.reserve(current ? current->entries.size() * 2 : 2);
+                    if (current)
+                        next->entries.insert(next->entries.end(), current->entries.begin(), current->entries.end());
+                    next->entries.emplace_back(std::move(fn), s);
+                    next->size.store(next->entries.size());
+                    _publish(current, next);
+                }
+            }
+            return s;
         }
 
-        /* consider https://stackoverflow.com/questions/15024223/how-to-implement-an-easy-bind-that-automagically-inserts-implied-placeholders */
-        template<typename Ret, typename Class, typename A1>
-        subscription subscribe(Ret (Class::*f)(A1), Class *instance) {
-            return subscribe(std::bind(f, static_cast<Class*>(instance), std::placeholders::_1));
-        }
-        template<typename Ret, typename Class, typename A1, typename A2>
-        subscription subscribe(Ret (Class::*f)(A1, A2), Class *instance) {
-            return subscribe(std::bind(f, static_cast<Class*>(instance), std::placeholders::_1, std::placeholders::_2));
+        /* member function pointer and instance are stored within the delegate itself, no allocation takes place */
+        template<typename Ret, typename Class, typename... FArgs, typename Instance>
+        subscription subscribe(Ret (Class::*f)(FArgs...), Instance *instance) {
+            return subscribe(fn_type(f, static_cast<Class*>(instance)));
         }
-        template<typename Ret, typename Class, typename A1, typename A2, typename A3>
-        subscription subscribe(Ret (Class::*f)(A1, A2, A3), Class *instance) {
-            return subscribe(std::bind(f, static_cast<Class*>(instance), std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+
+        /* same as above but the member function is known at compile time, use as subscribe<&Class::callback>(this) */
+        template<auto Method, typename Instance>
+        subscription subscribe(Instance *instance) {
+            return subscribe(fn_type::template bind<Method>(instance));
         }
 
+        /* once this returns, the subscriber will not be called by any emit that starts afterwards,
+        emits that are already in progress may still call it */
         void unsubscribe(subscription s)
         {
-            _callbacks.erase(
-                std::remove_if(_callbacks.begin(), _callbacks.end(), [&](const auto & e){return e.s == s;}),
-                _callbacks.end()
-            );
+            std::lock_guard lock(_mutex);
+            auto old = _current.load();
+            if (!old || std::none_of(old->entries.begin(), old->entries.end(), [&](const auto & e){return e.s == s;}))
+                return;
+
+            snapshot * next = nullptr;
+            if (old->entries.size() > 1)
+            {
+                next = new snapshot();
+                next->entries.reserve(old->entries.size());
+                for (const auto & e : old->entries)
+                    if (!(e.s == s))
+                        next->entries.push_back(e);
+                next->size.store(next->entries.size());
+            }
+            _publish(old, next);
         }
 
+        /* true when nobody is subscribed, emit does nothing then and the caller 
+        may skip preparing the arguments */
+        bool empty() const noexcept {return _current.load() == nullptr;}
+
+        /* every subscriber sees the same arguments, all but the last one get them as const references 
+        (a subscriber which takes an argument by value gets its own copy) and the last subscriber 
+        gets them moved, so a single subscriber never causes a copy */
         constexpr void emit(Args... arg) const
         {
-            for (auto& e : _callbacks)
+            /* nobody subscribed, there is nothing to protect */
+            if (!_current.load())
+                return;
+
+            reader_guard guard(*this);
+            const snapshot * current = _current.load();
+            if (current)
             {
-                if (e.fn->is_subs())
-                    e.fn->exec(std::forward<Args>(arg)...);
-                else
-                    e.fn->exec();
+                auto first = current->entries.data();
+                auto last = first + current->size.load() - 1;
+                for (auto it = first; it != last; ++it)
+                    it->fn.call_shared(arg...);
+                last->fn(std::forward<Args>(arg)...);
             }
         }
 
         private:
-        std::list<entry> _callbacks;
+
+        using epoch_type = std::size_t;
+
+        /* registers emit as a reader of the current epoch */
+        struct reader_guard
+        {
+            reader_guard(const subject & s) noexcept : _s(s)
+            {
+                while (true)
+                {
+                    auto e = _s._epoch.load();
+                    _slot = e & 1;
+                    _s._readers[_slot].fetch_add(1);
+                    /* the epoch may have moved on in the meantime, the reclaimer may not have 
+                    seen us then, so the registration is only valid if it did not */
+                    if (_s._epoch.load() == e)
+                        break;
+                    _s._readers[_slot].fetch_sub(1);
+                }
+            }
+
+            /* the last reader of an epoch frees what it was holding back */
+            ~reader_guard()
+            {
+                if (_s._readers[_slot].fetch_sub(1) == 1 && _s._has_retired.load() && _s._mutex.try_lock())
+                {
+                    _s._reclaim();
+                    _s._mutex.unlock();
+                }
+            }
+
+            const subject & _s;
+            epoch_type _slot;
+        };
+
+        /* must be called with _mutex held */
+        void _publish(const snapshot * old, snapshot * next) const
+        {
+            _current.store(next);
+            if (old)
+            {
+                _retired.push_back({old, _epoch.load()});
+                _has_retired.store(true);
+            }
+            _reclaim();
+        }
+
+        /* must be called with _mutex held, snapshots are retired only after the new one was published,
+        the readers which register afterwards cannot get hold of them */
+        void _reclaim() const
+        {
+            /* twice, the epoch advanced by the first pass may have no readers already */
+            for (int pass = 0; pass < 2 && !_retired.empty(); ++pass)
+            {
+                auto e = _epoch.load();
+                /* readers of the previous epoch are still running */
+                if (_readers[(e + 1) & 1].load() != 0)
+                    break;
+                /* only the readers of e are left, they registered after everything retired 
+                before e was published */
+                std::erase_if(_retired, [&](const auto & r){
+                    if (r.second >= e)
+                        return false;
+                    delete r.first;
+                    return true;
+                });
+                /* the rest is freed once the readers of e are gone */
+                if (!_retired.empty())
+                    _epoch.store(e + 1);
+            }
+            _has_retired.store(!_retired.empty());
+        }
+
+        mutable atomic<snapshot*> _current{nullptr};
+        mutable atomic<epoch_type> _epoch{0};
+        mutable atomic<std::size_t> _readers[2] = {0, 0};
+        mutable atomic<bool> _has_retired{false};
+        mutable std::vector<std::pair<const snapshot*, epoch_type>> _retired;
+        mutable mutex _mutex;
     };
 
 
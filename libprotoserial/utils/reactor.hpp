@@ -0,0 +1,239 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+/*
+ * the reactor runs many stacks on a fixed number of worker threads, every stack
+ * is pinned to a single worker which calls its main_task, so a stack is only
+ * ever touched by one thread and the layers need no synchronization.
+ *
+ *   sp::reactor r(4);
+ *   for (auto & s : stacks)
+ *       r.attach(s);
+ *   r.start();
+ *
+ * the per-thread state of the library follows the same split, object IDs are
+ * taken in per-thread blocks. Transfer IDs are the exception, the IDs of an
+ * interface must be unique on the wire whichever thread creates the transfer,
+ * the global_id_factory keeps one atomic counter per interface.
+ *
+ * traffic between stacks on different workers (routing, bonding) must not call
+ * into the other stack directly. Every worker is an executor with a lock-free
+ * inbox, so a deferred_subject bound to the destination's worker carries the
+ * events across, the subscribers then run on the destination's thread:
+ *
+ *   sp::deferred_subject<sp::fragment> to_uart3(r.worker_of(uart3), 64);
+ *   to_uart3.subscribe<&sp::interface::transmit>(&uart3.interface);
+ *
+ * stacks are attached before start(), the worker only polls the stacks, when its
+ * inbox is empty it sleeps for at most poll_period between the rounds (0 spins).
+ */
+
+#ifndef _SP_UTILS_REACTOR
+#define _SP_UTILS_REACTOR
+
+#include "libprotoserial/libconfig.hpp"
+#include "libprotoserial/utils/executor.hpp"
+
+#ifdef SP_THREADS
+
+#include <vector>
+#include <memory>
+#include <stdexcept>
+
+namespace sp
+{
+    class reactor
+    {
+        public:
+
+        using task_type = delegate<void()>;
+
+        class worker : public executor
+        {
+            public:
+
+            worker(std::size_t inbox_capacity, clock::duration poll_period) :
+                _inbox(inbox_capacity), _poll_period(poll_period) {}
+
+            /* queues t to be run on this worker's thread, callable from any thread */
+            bool post(executor::task_type && t)
+            {
+                if (!_inbox.push(std::move(t)))
+                    return false;
+                /* the worker only sleeps for the poll period, so should this race with _sleep
+                and the notification get lost, the task is delayed by at most that */
+                if (_sleeping.load())
+                {
+                    {
+                        std::lock_guard lock(_mutex);
+                    }
+                    _cv.notify_one();
+                }
+                return true;
+            }
+
+            /* number of stacks pinned to this worker */
+            std::size_t size() const noexcept {return _tasks.size();}
+            /* number of polling rounds done so far */
+            std::uint64_t rounds() const noexcept {return _rounds.load(std::memory_order_relaxed);}
+
+            private:
+            friend class reactor;
+
+            void _start()
+            {
+                _stop = false;
+                _thread = std::thread(&worker::_run, this);
+            }
+
+            void _join()
+            {
+                {
+                    std::lock_guard lock(_mutex);
+                    _stop = true;
+                }
+                _cv.notify_one();
+                if (_thread.joinable())
+                    _thread.join();
+            }
+
+            void _run()
+            {
+                executor::task_type t;
+                while (!_stop.load(std::memory_order_relaxed))
+                {
+                    while (_inbox.pop(t))
+                    {
+                        t();
+                        t = nullptr;
+                    }
+                    for (auto & task : _tasks)
+                        task();
+                    _rounds.fetch_add(1, std::memory_order_relaxed);
+
+                    if (_poll_period.count() > 0)
+                        _sleep();
+                }
+                /* tasks posted after the stop are dropped together with the inbox */
+            }
+
+            void _sleep()
+            {
+                _sleeping.store(true);
+                if (_inbox.empty())
+                {
+                    std::unique_lock lock(_mutex);
+                    _cv.wait_for(lock, _poll_period, [this]{return _stop.load() || !_inbox.empty();});
+                }
+                _sleeping.store(false);
+            }
+
+            std::vector<task_type> _tasks;
+            bounded_queue<executor::task_type> _inbox;
+            clock::duration _poll_period;
+            std::thread _thread;
+            std::mutex _mutex;
+            std::condition_variable _cv;
+            atomic<bool> _stop{false}, _sleeping{false};
+            atomic<std::uint64_t> _rounds{0};
+        };
+
+        /* inbox_capacity is the number of cross-worker tasks each worker can hold */
+        reactor(uint workers, std::size_t inbox_capacity = 1024, clock::duration poll_period = std::chrono::microseconds(100))
+        {
+            if (workers == 0)
+                throw std::invalid_argument("reactor needs at least one worker");
+            for (uint i = 0; i < workers; i++)
+                _workers.push_back(std::make_unique<worker>(inbox_capacity, poll_period));
+        }
+
+        reactor(const reactor &) = delete;
+        reactor & operator=(const reactor &) = delete;
+
+        ~reactor() {stop();}
+
+        /* pins the stack to the worker with the fewest stacks, the stack's main_task will
+        be called from that worker only, the stack must outlive the reactor */
+        template<typename Stack>
+        worker & attach(Stack & s)
+        {
+            std::size_t best = 0;
+            for (std::size_t i = 1; i < _workers.size(); i++)
+                if (_workers[i]->size() < _workers[best]->size())
+                    best = i;
+            return attach(s, best);
+        }
+
+        template<typename Stack>
+        worker & attach(Stack & s, std::size_t index)
+        {
+            if (_running)
+                throw std::logic_error("stacks must be attached before the reactor starts");
+            auto & w = *_workers.at(index);
+            w._tasks.push_back(task_type::template bind<&Stack::main_task>(&s));
+            _owners.emplace_back(static_cast<const void*>(&s), &w);
+            return w;
+        }
+
+        /* the worker the stack s was attached to */
+        template<typename Stack>
+        worker & worker_of(const Stack & s) const
+        {
+            for (auto & [stack, w] : _owners)
+                if (stack == static_cast<const void*>(&s))
+                    return *w;
+            throw std::out_of_range("the stack is not attached to this reactor");
+        }
+
+        void start()
+        {
+            if (_running)
+                return;
+            _running = true;
+            for (auto & w : _workers)
+                w->_start();
+        }
+
+        void stop()
+        {
+            if (!_running)
+                return;
+            for (auto & w : _workers)
+                w->_join();
+            _running = false;
+        }
+
+        bool running() const noexcept {return _running;}
+        std::size_t size() const noexcept {return _workers.size();}
+        worker & get_worker(std::size_t index) {return *_workers.at(index);}
+
+        private:
+
+        /* workers are allocated separately so that they do not share cache lines */
+        std::vector<std::unique_ptr<worker>> _workers;
+        std::vector<std::pair<const void*, worker*>> _owners;
+        bool _running = false;
+    };
+}
+
+#endif
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+/*
+ * hot-path tracing, the trace points are compiled in only when SP_TRACE is
+ * defined, otherwise the macros expand to nothing
+ *
+ *   SP_TRACE_SCOPE("parse_fragment", id);   begin and end of the enclosing scope
+ *   SP_TRACE_INSTANT("put_received", id);   single point in time
+ *
+ * the name must be a string literal, id is an arbitrary number carried along
+ * with the event, the trace points in the library pass the object_id of the
+ * fragment or transfer so that a single fragment can be followed through the
+ * stack, or the number of bytes where there is no such object yet.
+ *
+ * every thread records into its own ring of binary events, recording is a
+ * timestamp and a few stores, there are no locks and no allocations after the
+ * ring is created by the thread's first event. The ring keeps the most recent
+ * events, the older ones are overwritten.
+ *
+ * the rings are exported in the Chrome trace event format, which both
+ * chrome://tracing and ui.perfetto.dev open:
+ *
+ *   std::ofstream f("trace.json");
+ *   sp::trace::export_chrome(f);
+ *
+ * export (and clear) once the traced threads are quiet, events recorded during
+ * the export may come out torn.
+ */
+
+#ifndef _SP_UTILS_TRACE
+#define _SP_UTILS_TRACE
+
+#include "libprotoserial/libconfig.hpp"
+#include "libprotoserial/utils/atomic.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <ostream>
+
+namespace sp
+{
+namespace trace
+{
+    struct event
+    {
+        enum phase_type : char
+        {
+            BEGIN = 'B',
+            END = 'E',
+            INSTANT = 'i',
+        };
+
+        std::int64_t timestamp;
+        const char * name;
+        std::uint32_t id;
+        phase_type phase;
+    };
+
+    /* single producer ring, only the owning thread records into it */
+    class ring
+    {
+        public:
+
+        ring(std::size_t capacity, std::uint32_t thread_id) :
+            _mask(_round_up(capacity) - 1), _events(new event[_mask + 1]), _thread_id(thread_id) {}
+
+        void record(const char * name, std::uint32_t id, event::phase_type phase) noexcept
+        {
+            auto h = _head.load(std::memory_order_relaxed);
+            _events[h & _mask] = event{_now(), name, id, phase};
+            _head.store(h + 1, std::memory_order_release);
+        }
+
+        /* the retained events, oldest first */
+        std::vector<event> snapshot() const
+        {
+            auto h = _head.load(std::memory_order_acquire);
+            auto n = h < capacity() ? h : capacity();
+            std::vector<event> ret;
+            ret.reserve(n);
+            for (auto i = h - n; i != h; ++i)
+                ret.push_back(_events[i & _mask]);
+            return ret;
+        }
+
+        void clear() noexcept {_head.store(0, std::memory_order_release);}
+
+        std::size_t capacity() const noexcept {return _mask + 1;}
+        /* number of events recorded since the last clear, including the overwritten ones */
+        std::uint64_t recorded() const noexcept {return _head.load(std::memory_order_relaxed);}
+        std::uint32_t thread_id() const noexcept {return _thread_id;}
+
+        private:
+
+        static std::size_t _round_up(std::size_t v)
+        {
+            std::size_t r = 2;
+            while (r < v) r <<= 1;
+            return r;
+        }
+
+        static std::int64_t _now() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        const std::size_t _mask;
+        std::unique_ptr<event[]> _events;
+        atomic<std::uint64_t> _head{0};
+        std::uint32_t _thread_id;
+    };
+
+    /* owns the rings of all threads, they outlive their threads so that the events of
+    finished threads can still be exported */
+    class registry
+    {
+        public:
+
+        /* number of events each thread retains */
+        static constexpr std::size_t ring_capacity = 1 << 14;
+
+        static registry & instance()
+        {
+            static registry r;
+            return r;
+        }
+
+        /* ring of the calling thread, created by the thread's first call */
+        ring & local()
+        {
+#ifdef SP_THREADS
+            thread_local ring * r = nullptr;
+#else
+            static ring * r = nullptr;
+#endif
+            if (!r)
+            {
+                std::lock_guard lock(_mutex);
+                r = _rings.emplace_back(std::make_shared<ring>(ring_capacity, (std::uint32_t)_rings.size() + 1)).get();
+            }
+            return *r;
+        }
+
+        std::vector<std::shared_ptr<const ring>> rings() const
+        {
+            std::lock_guard lock(_mutex);
+            return std::vector<std::shared_ptr<const ring>>(_rings.begin(), _rings.end());
+        }
+
+        void clear()
+        {
+            std::lock_guard lock(_mutex);
+            for (auto & r : _rings)
+                r->clear();
+        }
+
+        private:
+
+        registry() = default;
+
+        mutable mutex _mutex;
+        std::vector<std::shared_ptr<ring>> _rings;
+    };
+
+    inline void record(const char * name, std::uint32_t id, event::phase_type phase) noexcept
+    {
+        registry::instance().local().record(name, id, phase);
+    }
+
+    /* records BEGIN now and END when it goes out of scope */
+    class scope
+    {
+        public:
+
+        scope(const char * name, std::uint32_t id) noexcept :
+            _ring(registry::instance().local()), _name(name), _id(id)
+        {
+            _ring.record(_name, _id, event::BEGIN);
+        }
+
+        scope(const scope &) = delete;
+        scope & operator=(const scope &) = delete;
+
+        ~scope() {_ring.record(_name, _id, event::END);}
+
+        private:
+        ring & _ring;
+        const char * _name;
+        std::uint32_t _id;
+    };
+
+    /* writes the events of the given rings as a Chrome trace JSON document, timestamps
+    are in microseconds with nanosecond decimals */
+    inline void export_chrome(std::ostream & os, const std::vector<std::shared_ptr<const ring>> & rings)
+    {
+        os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        for (auto & r : rings)
+        {
+            for (auto & e : r->snapshot())
+            {
+                os << (first ? "\n" : ",\n");
+                first = false;
+                os << "{\"name\":\"" << e.name << "\",\"ph\":\"" << (char)e.phase << "\",\"ts\":"
+                    << e.timestamp / 1000 << '.';
+                auto ns = e.timestamp % 1000;
+                os << (char)('0' + ns / 100) << (char)('0' + ns / 10 % 10) << (char)('0' + ns % 10);
+                os << ",\"pid\":1,\"tid\":" << r->thread_id();
+                if (e.phase == event::INSTANT)
+                    os << ",\"s\":\"t\"";
+                os << ",\"args\":{\"id\":" << e.id << "}}";
+            }
+        }
+        os << "\n]}\n";
+    }
+
+    inline void export_chrome(std::ostream & os)
+    {
+        export_chrome(os, registry::instance().rings());
+    }
+}
+}
+
+#define _SP_TRACE_CONCAT_IMPL(a, b) a##b
+#define _SP_TRACE_CONCAT(a, b) _SP_TRACE_CONCAT_IMPL(a, b)
+
+#ifdef SP_TRACE
+#define SP_TRACE_SCOPE(name, id) ::sp::trace::scope _SP_TRACE_CONCAT(_sp_trace_scope_, __LINE__)((name), (std::uint32_t)(id))
+#define SP_TRACE_INSTANT(name, id) ::sp::trace::record((name), (std::uint32_t)(id), ::sp::trace::event::INSTANT)
+#else
+#define SP_TRACE_SCOPE(name, id) ((void)0)
+#define SP_TRACE_INSTANT(name, id) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * This file is a part of the libprotoserial project
+ * https://github.com/georges-circuits/libprotoserial
+ *
+ * Copyright (C) 2022 Jiří Maňák - All Rights Reserved
+ * For contact information visit https://manakjiri.eu/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/gpl.html>
+ */
+
+/*
+ * lets an idle stack sleep until there is something to do, instead of calling
+ * main_task in a spin loop
+ *
+ * - on Linux wait_until blocks in poll() on the watched file descriptors (the
+ *   UART's fd for example) and on an eventfd which notify() signals, so data
+ *   put into a stack from another thread wakes it up as well
+ * - on STM32 wait_until sleeps the core using WFI, any interrupt (UART receive,
+ *   SysTick) wakes it up, the caller checks whether there is work and the
+ *   deadline and goes back to sleep if not
+ * - elsewhere wait_until returns right away, which degrades to polling
+ *
+ * wait_until returns true when it was woken up before the deadline, which does
+ * not guarantee that there is work to do, false when the deadline passed.
+ * input_ready tells whether the last wait_until returned because a watched file
+ * descriptor has data, which the layers only notice once main_task reads it.
+ */
+
+#ifndef _SP_UTILS_WAKEUP
+#define _SP_UTILS_WAKEUP
+
+#include "libprotoserial/libconfig.hpp"
+#include "libprotoserial/clock.hpp"
+
+#if defined(SP_LINUX)
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace sp
+{
+#if defined(SP_LINUX)
+
+    class wakeup
+    {
+        public:
+
+        wakeup() :
+            _event_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+        {
+            if (_event_fd < 0)
+                throw std::runtime_error("eventfd failed");
+            _fds.push_back(pollfd{_event_fd, POLLIN, 0});
+        }
+
+        wakeup(const wakeup &) = delete;
+        wakeup & operator=(const wakeup &) = delete;
+
+        ~wakeup() {close(_event_fd);}
+
+        /* wait_until also returns once fd becomes readable */
+        void watch(int fd)
+        {
+            if (fd >= 0)
+                _fds.push_back(pollfd{fd, POLLIN, 0});
+        }
+
+        /* wakes up the current or the next wait_until, callable from any thread */
+        void notify() noexcept
+        {
+            std::uint64_t v = 1;
+            [[maybe_unused]] auto r = write(_event_fd, &v, sizeof(v));
+        }
+
+        bool wait_until(clock::time_point deadline)
+        {
+            int timeout = -1;
+            if (deadline != no_deadline())
+            {
+                auto now = clock::now();
+                if (deadline <= now)
+                    return false;
+                /* rounded up, waking up early would only make the caller wait once more */
+                auto ms = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+                timeout = ms > INT_MAX ? INT_MAX : (int)ms;
+            }
+
+            int ready = poll(_fds.data(), _fds.size(), timeout);
+            if (ready > 0 && (_fds[0].revents & POLLIN))
+            {
+                std::uint64_t v;
+                [[maybe_unused]] auto r = read(_event_fd, &v, sizeof(v));
+            }
+            /* a hang up or an error is left for main_task to find out about as well */
+            _input_ready = ready > 0 && std::any_of(_fds.begin() + 1, _fds.end(), [](const pollfd & p){
+                return p.revents & (POLLIN | POLLHUP | POLLERR);
+            });
+            return ready > 0;
+        }
+
+        bool input_ready() const noexcept {return _input_ready;}
+
+        private:
+        int _event_fd;
+        std::vector<pollfd> _fds;
+        bool _input_ready = false;
+    };
+
+#else
+
+    class wakeup
+    {
+        public:
+
+        wakeup() = default;
+        wakeup(const wakeup &) = delete;
+        wakeup & operator=(const wakeup &) = delete;
+
+        /* there are no file descriptors to watch on this platform */
+        void watch(int) {}
+
+        /* can be called from an interrupt */
+        void notify() noexcept {_pending = true;}
+
+        bool wait_until(clock::time_point deadline)
+        {
+            if (deadline != no_deadline() && deadline <= clock::now())
+                return false;
+#if defined(SP_STM32)
+            /* the interrupts we would wake up for may have already happened */
+            if (!_pending)
+                __WFI();
+#endif
+            _pending = false;
+            return true;
+        }
+
+        /* the received data is already in the buffers when the interrupt wakes us up */
+        bool input_ready() const noexcept {return false;}
+
+        private:
+        volatile bool _pending = false;
+    };
+
+#endif
+}
+
+#endif
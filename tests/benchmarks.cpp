@@ -0,0 +1,273 @@
+
+/* micro-benchmarks of the hot paths, built as bench_libprotoserial by cmake
+ *
+ *   cmake -S . -B build -DCMAKE_BUILD_TYPE=Release && cmake --build build
+ *   ./build/bench_libprotoserial --benchmark_out=bench.json --benchmark_out_format=json
+ *
+ * every benchmark reports bytes/s where it processes data and allocs/op, the number of
+ * heap allocations per iteration, counted by the replaced global operator new below
+ */
+
+#include <libprotoserial/interface.hpp>
+#include <libprotoserial/fragmentation.hpp>
+#include <libprotoserial/ports/ports.hpp>
+#include <libprotoserial/protostacks.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace sp::literals;
+
+
+static std::atomic<std::size_t> allocations = 0;
+
+void * operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept {std::free(p);}
+void operator delete(void * p, std::size_t) noexcept {std::free(p);}
+
+/* counts the allocations made while it is alive and reports them per iteration */
+struct allocation_counter
+{
+    allocation_counter(benchmark::State & s) :
+        state(s), start(allocations.load(std::memory_order_relaxed)) {}
+
+    ~allocation_counter()
+    {
+        state.counters["allocs/op"] = benchmark::Counter(
+            (double)(allocations.load(std::memory_order_relaxed) - start), benchmark::Counter::kAvgIterations);
+    }
+
+    benchmark::State & state;
+    std::size_t start;
+};
+
+static sp::bytes pattern(sp::bytes::size_type size)
+{
+    sp::bytes b(size);
+    for (sp::bytes::size_type i = 0; i < size; ++i)
+        b[i] = (sp::byte)(i * 7);
+    return b;
+}
+
+/* pumps the serialized fragments of one virtual interface into the other */
+static void pump(sp::virtual_interface & src, sp::virtual_interface & dst)
+{
+    while (src.has_serialized())
+        dst.put_serialized(src.get_serialized());
+}
+
+
+/* bytes */
+
+static void BM_BytesCopy(benchmark::State & state)
+{
+    auto src = pattern(state.range(0));
+    allocation_counter c(state);
+    for (auto _ : state)
+    {
+        sp::bytes b(src);
+        benchmark::DoNotOptimize(b.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BytesCopy)->RangeMultiplier(4)->Range(16, 4096);
+
+/* what the interface does to every transmitted fragment, header in front, footer at the back */
+static void BM_BytesPushFrontBack(benchmark::State & state)
+{
+    auto header = pattern(4), footer = pattern(4);
+    allocation_counter c(state);
+    for (auto _ : state)
+    {
+        sp::bytes b(8, state.range(0), 8);
+        b.push_front(header);
+        b.push_back(footer);
+        benchmark::DoNotOptimize(b.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BytesPushFrontBack)->RangeMultiplier(4)->Range(16, 4096);
+
+/* same as above, but without preallocated space, so the data has to move */
+static void BM_BytesPushFrontBackRealloc(benchmark::State & state)
+{
+    auto header = pattern(4), footer = pattern(4);
+    allocation_counter c(state);
+    for (auto _ : state)
+    {
+        sp::bytes b(state.range(0));
+        b.push_front(header);
+        b.push_back(footer);
+        benchmark::DoNotOptimize(b.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BytesPushFrontBackRealloc)->RangeMultiplier(4)->Range(16, 4096);
+
+static void BM_BytesSub(benchmark::State & state)
+{
+    auto src = pattern(state.range(0));
+    allocation_counter c(state);
+    for (auto _ : state)
+    {
+        auto b = src.sub(1, src.size() - 2);
+        benchmark::DoNotOptimize(b.data());
+    }
+    state.SetBytesProcessed(state.iterations() * (state.range(0) - 2));
+}
+BENCHMARK(BM_BytesSub)->RangeMultiplier(4)->Range(16, 4096);
+
+
+/* parsers */
+
+/* the receive path looks for the preamble in the circular rx buffer, the search starts in
+the middle so that it wraps around */
+static void BM_CircularIteratorFind(benchmark::State & state)
+{
+    sp::bytes buff(state.range(0));
+    buff.set(0_BYTE);
+    auto middle = buff.begin() + buff.size() / 2;
+    *(middle - 1) = 0x55_BYTE;
+    sp::detail::buffered_interface::circular_iterator begin(buff.begin(), buff.end(), middle);
+    auto end = begin + (buff.size() - 1);
+    allocation_counter c(state);
+    for (auto _ : state)
+    {
+        auto it = begin;
+        benchmark::DoNotOptimize(sp::parsers::find(it, end, 0x55_BYTE));
+        /* end is excluded, so the preamble is never found, the search covers the whole buffer */
+        benchmark::DoNotOptimize(it);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CircularIteratorFind)->RangeMultiplier(4)->Range(64, 16384);
+
+static void BM_ParseFragment(benchmark::State & state)
+{
+    sp::virtual_interface i(0, 1, 255, 16, 256, 4096);
+    i.transmit(sp::fragment(2, pattern(state.range(0))));
+    i.main_task();
+    auto serialized = i.get_serialized();
+    /* parse_fragment gets the fragment without its preamble */
+    serialized.shrink(i.overhead_size() - sizeof(sp::headers::interface_8b8b) - sizeof(sp::footers::crc32), 0);
+    allocation_counter c(state);
+    for (auto _ : state)
+    {
+        auto f = sp::parsers::parse_fragment<sp::headers::interface_8b8b, sp::footers::crc32>(sp::bytes(serialized), i);
+        benchmark::DoNotOptimize(f.data().data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParseFragment)->RangeMultiplier(2)->Range(8, 250);
+
+
+/* footers */
+
+template<typename Footer>
+static void BM_Footer(benchmark::State & state)
+{
+    auto data = pattern(state.range(0));
+    allocation_counter c(state);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Footer(data).hash);
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_Footer, sp::footers::crc32)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK_TEMPLATE(BM_Footer, sp::footers::crc16)->RangeMultiplier(4)->Range(16, 4096);
+
+
+/* observer */
+
+static void BM_SubjectEmit(benchmark::State & state)
+{
+    sp::subject<int> s;
+    int sum = 0;
+    for (int64_t i = 0; i < state.range(0); ++i)
+        s.subscribe([&](int v){sum += v;});
+    allocation_counter c(state);
+    for (auto _ : state)
+        s.emit(1);
+    benchmark::DoNotOptimize(sum);
+}
+BENCHMARK(BM_SubjectEmit)->Arg(0)->Arg(1)->Arg(4)->Arg(16);
+
+/* fragment sized payloads are moved into the subscriber, not copied */
+static void BM_SubjectEmitFragment(benchmark::State & state)
+{
+    sp::subject<sp::fragment> s;
+    sp::bytes::size_type size = 0;
+    s.subscribe([&](sp::fragment f){size += f.data().size();});
+    auto data = pattern(state.range(0));
+    allocation_counter c(state);
+    for (auto _ : state)
+        s.emit(sp::fragment(2, sp::bytes(data)));
+    benchmark::DoNotOptimize(size);
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SubjectEmitFragment)->Arg(64)->Arg(250);
+
+
+/* fragmentation, transfers of range(0) bytes from a to b over a lossless virtual link,
+one transfer per iteration including its acknowledgement */
+
+static void BM_FragmentationVirtual(benchmark::State & state)
+{
+    sp::stack::virtual_full a(0, 1, 1000000), b(1, 2, 1000000);
+    uint received = 0;
+    b.fragmentation.transfer_receive_event.subscribe([&](sp::transfer){++received;});
+    auto data = pattern(state.range(0));
+
+    allocation_counter c(state);
+    for (auto _ : state)
+    {
+        auto iid = a.interface.interface_id();
+        a.fragmentation.transmit(sp::transfer(sp::transfer_metadata(0, 2, iid, sp::clock::now(),
+            sp::global_id_factory.new_id(iid), 0), sp::bytes(data)));
+        for (auto target = received + 1; received < target;)
+        {
+            a.main_task();
+            pump(a.interface, b.interface);
+            b.main_task();
+            pump(b.interface, a.interface);
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FragmentationVirtual)->RangeMultiplier(4)->Range(16, 4096);
+
+
+/* ports, dispatch of a received transfer to the registered service */
+
+static void BM_PortsDispatch(benchmark::State & state)
+{
+    sp::ports_handler ports;
+    sp::interface_identifier iid(sp::interface_identifier::identifier_type::VIRTUAL, 0);
+    auto & ie = ports.register_interface(iid);
+    auto & se = ports.register_port(5);
+    uint received = 0;
+    se.receive_event.subscribe([&](sp::packet){++received;});
+
+    auto data = sp::to_bytes(sp::headers::ports_8b(5, 1)) + pattern(state.range(0));
+    allocation_counter c(state);
+    for (auto _ : state)
+    {
+        sp::transfer t(sp::transfer_metadata(1, 2, iid, sp::clock::now(), 1, 0), sp::bytes(data));
+        ie.transfer_receive_callback(std::move(t));
+    }
+    benchmark::DoNotOptimize(received);
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PortsDispatch)->Arg(16)->Arg(256);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,75 @@
+
+/* host-side stand-in for the parts of the STM32 HAL used by the stm32 interfaces, include it
+ * before the interface. The UART moves one byte per tick(), which stands for one byte time on
+ * the line, and calls tx_complete once a transmit is done, like HAL_UART_TxCpltCallback would
+ */
+
+#ifndef _SP_TESTS_STM32_HAL
+#define _SP_TESTS_STM32_HAL
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+enum HAL_StatusTypeDef
+{
+    HAL_OK,
+    HAL_ERROR,
+    HAL_BUSY,
+};
+
+struct GPIO_TypeDef {};
+inline GPIO_TypeDef hal_stub_gpio;
+#define DBG1_GPIO_Port (&hal_stub_gpio)
+#define DBG1_Pin 0
+
+struct UART_HandleTypeDef
+{
+    /* advances the line by one byte time */
+    void tick()
+    {
+        ++ticks;
+        if (tx_remaining == 0)
+            return;
+        line.push_back(*tx_data++);
+        ++busy_ticks;
+        if (--tx_remaining == 0 && tx_complete)
+            tx_complete();
+    }
+
+    const std::uint8_t * tx_data = nullptr;
+    std::uint16_t tx_remaining = 0;
+    /* the interrupt, called from within tick() */
+    std::function<void()> tx_complete;
+    /* every byte that went out */
+    std::vector<std::uint8_t> line;
+    std::uint64_t ticks = 0, busy_ticks = 0;
+    /* anything other than HAL_OK makes the transmits fail with it */
+    HAL_StatusTypeDef tx_status = HAL_OK;
+};
+
+inline HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef * huart, std::uint8_t * data, std::uint16_t size)
+{
+    if (huart->tx_status != HAL_OK)
+        return huart->tx_status;
+    if (huart->tx_remaining != 0)
+        return HAL_BUSY;
+    huart->tx_data = data;
+    huart->tx_remaining = size;
+    return HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef * huart, std::uint8_t * data, std::uint16_t size)
+{
+    return HAL_UART_Transmit_DMA(huart, data, size);
+}
+
+inline HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *, std::uint8_t *, std::uint16_t) {return HAL_OK;}
+inline void HAL_GPIO_TogglePin(GPIO_TypeDef *, std::uint16_t) {}
+inline std::uint32_t HAL_GetTick() {return 0;}
+
+/* the interrupt runs synchronously within tick(), there is nothing to mask */
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+
+#endif
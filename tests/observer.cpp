@@ -4,10 +4,90 @@
 
 #include "libprotoserial/utils/observer.hpp"
 
+#include <list>
+#include <memory>
+
 using namespace std;
 using namespace std::placeholders;
 
 
+/* the previous subject implementation (heap allocated std::function wrapping a std::bind, 
+kept in a std::list with virtual dispatch), kept here as the baseline for comparison */
+namespace legacy
+{
+    template<typename... Args>
+    struct subject
+    {
+        using fn_type = std::function<void(Args...)>;
+        
+        private:
+        struct fn_base 
+        {
+            virtual ~fn_base() {}
+            virtual void exec(Args... arg) {}
+            virtual void exec() {}
+            virtual bool is_subs() const = 0;
+        };
+        struct fn_subs : public fn_base
+        {
+            fn_type fn;
+            fn_subs(fn_type f) : fn(f) {}
+            void exec(Args... arg) {fn(std::forward<Args>(arg)...);}
+            bool is_subs() const {return true;}
+        };
+        struct fn_watch : public fn_base
+        {
+            std::function<void(void)> fn;
+            fn_watch(std::function<void(void)> f) : fn(f) {}
+            void exec() {fn();}
+            bool is_subs() const {return false;}
+        };
+
+        struct entry
+        {
+            std::unique_ptr<fn_base> fn;
+            sp::subscription s;
+        };
+
+        public:
+
+        sp::subscription watch(std::function<void(void)> fn)
+        {
+            auto f = std::unique_ptr<fn_base>(new fn_watch(fn));
+            auto & t = _callbacks.emplace_back(std::move(f), sp::subscription());
+            return t.s;
+        }
+        template<typename Class>
+        sp::subscription watch(void(Class::*f)(), Class *instance) {
+            return watch(std::bind(f, static_cast<Class*>(instance)));
+        }
+        sp::subscription subscribe(fn_type fn)
+        {
+            auto f = std::unique_ptr<fn_base>(new fn_subs(fn));
+            auto & t = _callbacks.emplace_back(std::move(f), sp::subscription());
+            return t.s;
+        }
+        template<typename Ret, typename Class, typename A1, typename A2>
+        sp::subscription subscribe(Ret (Class::*f)(A1, A2), Class *instance) {
+            return subscribe(std::bind(f, static_cast<Class*>(instance), std::placeholders::_1, std::placeholders::_2));
+        }
+        void emit(Args... arg) const
+        {
+            for (auto& e : _callbacks)
+            {
+                if (e.fn->is_subs())
+                    e.fn->exec(std::forward<Args>(arg)...);
+                else
+                    e.fn->exec();
+            }
+        }
+
+        private:
+        std::list<entry> _callbacks;
+    };
+}
+
+
 static int callback1_count = 0;
 static int callback2_count = 0;
 
@@ -46,63 +126,75 @@ for(int i = 0; i < repeats; ++i) {\
 auto diff = (chrono::steady_clock::now() - start) / repeats;\
 cout << name << ": "<< chrono::duration<double, nano>(diff).count() << " ns" << endl;
 
-int main(int argc, char const *argv[])
+template<template<typename...> class Subject>
+void run_suite(const string & name, int N)
 {
-
-    /* s.subscribe(bind(&observer::callback, &o, _1, _2));
-    //s.subscribe(&observer::callback, &o);
-    s.subscribe(callback1);
-    auto subs = s.subscribe(callback2);
-    s.emit(0, "hello");
-
-    s.unsubscribe(subs);
-    s.emit(1, "world"); */
-
-    auto N = 1000;
-
-/*     auto test = [&](string name, auto &s){
-        auto start = chrono::steady_clock::now();
-        for(int i = 0; i < N; ++i) {
-            s.emit(i, "world");
-        }
-        auto diff = (chrono::steady_clock::now() - start) / N;
-        cout << name << ": "<< chrono::duration<double, nano>(diff).count() << " ns" << endl;
-    }; */
-
-    {
-        TIME_THIS(N, "jsut fn", callback2(i, "world"));
-        cout << callback2_count << endl;
-    }
+    cout << "--- " << name << " ---" << endl;
 
     {
-        sp::subject<int, string> s;
+        Subject<int, string> s;
         TIME_THIS(N, "none", s.emit(i, "world"));
     }
 
     {
-        sp::subject<int, string> s;
+        Subject<int, string> s;
         s.subscribe(callback1);
         TIME_THIS(N, "normal", s.emit(i, "world"));
-        cout << callback1_count << endl;
     }
 
     {
         observer o;
-        sp::subject<int, string> s;
+        Subject<int, string> s;
         s.subscribe(&observer::callback, &o);
         TIME_THIS(N, "member", s.emit(i, "world"));
-        cout << o.count << endl;
     }
 
     {
         observer o;
-        sp::subject<int, string> s;
+        Subject<int, string> s;
         s.subscribe(&observer::callback, &o);
         s.watch(&observer::watch_callback, &o);
         TIME_THIS(N, "member + watch", s.emit(i, "world"));
-        cout << o.count << endl;
     }
 
+    {
+        vector<observer> o(16);
+        Subject<int, string> s;
+        for (auto & ob : o)
+            s.subscribe(&observer::callback, &ob);
+        TIME_THIS(N, "16 members", s.emit(i, "world"));
+    }
+
+    {
+        vector<observer> o(N);
+        auto start = chrono::steady_clock::now();
+        {
+            Subject<int, string> s;
+            for (auto & ob : o)
+                s.subscribe(&observer::callback, &ob);
+        }
+        auto diff = (chrono::steady_clock::now() - start) / N;
+        cout << "subscribe + destroy: " << chrono::duration<double, nano>(diff).count() << " ns" << endl;
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    auto N = 100000;
+
+    {
+        TIME_THIS(N, "just fn", callback2(i, "world"));
+    }
+
+    run_suite<legacy::subject>("legacy (std::list + std::function)", N);
+    run_suite<sp::subject>("sp::subject (std::vector + delegate)", N);
+
+    {
+        observer o;
+        sp::subject<int, string> s;
+        s.subscribe<&observer::callback>(&o);
+        TIME_THIS(N, "sp::subject compile-time bound member", s.emit(i, "world"));
+    }
 
     return 0;
 }
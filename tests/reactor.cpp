@@ -0,0 +1,65 @@
+
+/* aggregate fragment rate of 16 independent links sharded across a growing number of reactor
+ * workers, every link is a pair of virtual interfaces pumping fragments from a to b
+ */
+
+#include "libprotoserial/interface.hpp"
+#include "libprotoserial/utils/reactor.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <list>
+
+using namespace std;
+
+struct link_stack
+{
+    link_stack(sp::interface_identifier::instance_type instance) :
+        a(instance * 2, 1, 255, 16, 256, 4096), b(instance * 2 + 1, 2, 255, 16, 256, 4096)
+    {
+        b.receive_event.subscribe([this](sp::fragment f){received.fetch_add(1, memory_order_relaxed);});
+    }
+
+    void main_task()
+    {
+        if (a.is_writable())
+            a.transmit(sp::fragment(2, sp::bytes(64)));
+        a.main_task();
+        while (a.has_serialized())
+            b.put_serialized(a.get_serialized());
+        b.main_task();
+    }
+
+    sp::virtual_interface a, b;
+    atomic<uint64_t> received = 0;
+};
+
+void run(uint workers, uint links, chrono::milliseconds duration)
+{
+    list<link_stack> stacks;
+    for (uint i = 0; i < links; i++)
+        stacks.emplace_back(i);
+
+    sp::reactor r(workers, 64, 0s);
+    for (auto & s : stacks)
+        r.attach(s);
+
+    r.start();
+    this_thread::sleep_for(duration);
+    r.stop();
+
+    uint64_t received = 0;
+    for (auto & s : stacks)
+        received += s.received;
+    chrono::duration<double> d = duration;
+    cout << workers << " workers, " << links << " links: " << (uint64_t)(received / d.count()) << " fragments/s" << endl;
+}
+
+int main(int argc, char const *argv[])
+{
+    for (uint workers : {1, 2, 4, 8})
+        run(workers, 16, 2000ms);
+
+    return 0;
+}
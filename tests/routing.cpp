@@ -0,0 +1,69 @@
+
+/* forwarding rate of the router, node a sends fragments to node b through a gateway
+ * bridging two buses
+ *
+ *   a (1) --- bus 0 --- (10) gateway (11) --- bus 1 --- (3) b
+ */
+
+#include "libprotoserial/interface.hpp"
+#include "libprotoserial/routing/router.hpp"
+
+#include <iostream>
+#include <chrono>
+
+using namespace std;
+using namespace sp::literals;
+
+/* moves everything serialized by src into dst */
+void pump(sp::virtual_interface & src, sp::virtual_interface & dst)
+{
+    while (src.has_serialized())
+        dst.put_serialized(src.get_serialized());
+}
+
+void run(uint fragment_size, uint count)
+{
+    sp::virtual_interface a(0, 1, 255, 16, 256, 4096), g0(1, 10, 255, 16, 256, 4096);
+    sp::virtual_interface g1(2, 11, 255, 16, 256, 4096), b(3, 3, 255, 16, 256, 4096);
+
+    sp::router r;
+    r.add_interface(g0);
+    r.add_interface(g1);
+    r.add_route(3, g1);
+
+    uint received = 0;
+    b.receive_event.subscribe([&](sp::fragment f){
+        if (f.source() == 1) ++received;
+    });
+
+    auto start = chrono::steady_clock::now();
+    uint sent = 0;
+    while (received < count)
+    {
+        if (sent < count && a.is_writable())
+        {
+            a.transmit(sp::fragment(3, sp::bytes(fragment_size)));
+            ++sent;
+        }
+        a.main_task();
+        pump(a, g0);
+        g0.main_task();
+        g1.main_task();
+        pump(g1, b);
+        b.main_task();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    auto & s = r.get_statistics();
+    cout << "fragment size " << fragment_size << ": " << (uint)(count / elapsed.count()) << " fragments/s, "
+        << (uint)(count * fragment_size / elapsed.count() / 1000) << " kB/s payload, forwarded "
+        << s.forwarded << ", rejected " << s.rejected << ", no route " << s.no_route << endl;
+}
+
+int main(int argc, char const *argv[])
+{
+    for (uint size : {8, 32, 64, 128, 250})
+        run(size, 100000);
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <string>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+
+#include "libprotoserial/serializer.hpp"
+
+using namespace std;
+namespace ser = sp::serializer;
+
+/* compares the schema serializer with the hand-rolled packing the services use today,
+a packed struct copied in with to_bytes() and read back with a reinterpret_cast */
+
+struct __attribute__ ((__packed__)) telemetry_packed
+{
+    uint8_t mode;
+    int16_t temperature;
+    uint32_t uptime;
+    float voltage;
+};
+
+struct telemetry
+{
+    uint8_t mode;
+    int16_t temperature;
+    uint32_t uptime;
+    float voltage;
+};
+
+using telemetry_schema = ser::schema<telemetry, 0, ser::field<&telemetry::mode>, ser::field<&telemetry::temperature>,
+    ser::field<&telemetry::uptime>, ser::field<&telemetry::voltage>>;
+
+struct log_entry
+{
+    uint16_t code;
+    string text;
+};
+
+using log_schema = ser::schema<log_entry, 0, ser::field<&log_entry::code>, ser::blob_field<&log_entry::text>>;
+
+/* keeps the compiler from optimizing the measured expression away */
+template<typename T>
+void consume(const T & v) {asm volatile("" : : "g"(&v) : "memory");}
+
+#define TIME_THIS(repeats, name, exp) \
+{\
+auto start = chrono::steady_clock::now();\
+for(int i = 0; i < repeats; ++i) {\
+    exp;\
+}\
+auto diff = (chrono::steady_clock::now() - start) / repeats;\
+cout << name << ": "<< chrono::duration<double, nano>(diff).count() << " ns" << endl;\
+}
+
+int main(int argc, char const *argv[])
+{
+    const int N = 1000000;
+
+    telemetry t{3, -12, 123456, 3.3f};
+    telemetry_packed tp{3, -12, 123456, 3.3f};
+    log_entry l{42, "battery voltage below threshold"};
+
+    cout << "--- encode ---" << endl;
+    TIME_THIS(N, "hand-rolled to_bytes", auto b = sp::to_bytes(tp); consume(b));
+    TIME_THIS(N, "schema to_bytes", auto b = telemetry_schema::to_bytes(t); consume(b));
+    sp::bytes into(0, 0, 1024);
+    TIME_THIS(N, "schema encode into preallocated (incl. shrink)", telemetry_schema::encode(t, into); consume(into); into.shrink(0, into.size()));
+    TIME_THIS(N, "hand-rolled blob", 
+        sp::bytes b(sizeof(uint16_t) + 1 + l.text.size());
+        memcpy(b.data(), &l.code, 2); b[2] = (sp::byte)l.text.size(); memcpy(b.data() + 3, l.text.data(), l.text.size());
+        consume(b));
+    TIME_THIS(N, "schema blob", auto b = log_schema::to_bytes(l); consume(b));
+
+    cout << "--- decode ---" << endl;
+    auto pb = sp::to_bytes(tp);
+    auto sb = telemetry_schema::to_bytes(t);
+    auto lb = log_schema::to_bytes(l);
+    TIME_THIS(N, "hand-rolled field", auto v = reinterpret_cast<const telemetry_packed*>(pb.data())->uptime; consume(v));
+    TIME_THIS(N, "schema parse + field", auto v = telemetry_schema::parse(sb)->get<&telemetry::uptime>(); consume(v));
+    TIME_THIS(N, "schema decode all", auto v = telemetry_schema::decode(sb); consume(v));
+    TIME_THIS(N, "schema blob view", auto v = log_schema::parse(lb)->get<&log_entry::text>(); consume(v));
+    TIME_THIS(N, "schema blob decode", auto v = log_schema::decode(lb); consume(v));
+
+    return 0;
+}
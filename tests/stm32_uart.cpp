@@ -0,0 +1,62 @@
+
+/* line utilization of the STM32 UART transmit on the host, using the HAL stand-in from helpers
+ * the main loop only gets to call main_task every `period` byte times, the transmit complete
+ * interrupt chains the buffer the main loop has filled in the meantime, so the line should stay
+ * busy for as long as the period is shorter than a single fragment
+ */
+
+#include "helpers/stm32_hal.hpp"
+#include "libprotoserial/interface.hpp"
+#include "libprotoserial/interface/stm32/uart.hpp"
+
+#include <iostream>
+
+using namespace std;
+
+struct uart : public sp::detail::stm32::uart_interface<sp::headers::interface_8b8b, sp::footers::crc32>
+{
+    uart(UART_HandleTypeDef * h) :
+        sp::detail::stm32::uart_interface<sp::headers::interface_8b8b, sp::footers::crc32>(h, 0, 1, 255, 4, 64, 256) {}
+
+    sp::prealloc_size minimum_prealloc() const noexcept {return sp::prealloc_size();}
+};
+
+/* returns the fraction of byte times the line was busy between the first and the last byte */
+double run(uint period, uint fragments, uint data_size)
+{
+    UART_HandleTypeDef huart;
+    uart u(&huart);
+    huart.tx_complete = [&]{u.isr_tx_done();};
+
+    auto expected = (uint64_t)fragments * (data_size + u.overhead_size());
+    uint queued = 0;
+    int64_t first = -1;
+    /* a period far longer than a fragment would still finish, 10x the ideal time is a hang */
+    while (huart.line.size() < expected && huart.ticks < expected * period * 10)
+    {
+        if (huart.ticks % period == 0)
+        {
+            while (queued < fragments && u.is_writable())
+            {
+                u.transmit(sp::fragment(2, sp::bytes(data_size)));
+                ++queued;
+            }
+            u.main_task();
+        }
+        if (first < 0 && huart.tx_remaining)
+            first = huart.ticks;
+        huart.tick();
+    }
+    if (huart.line.size() != expected)
+        cout << "sent " << huart.line.size() << " bytes, expected " << expected << endl;
+    return (double)huart.busy_ticks / (huart.ticks - first);
+}
+
+int main(int argc, char const *argv[])
+{
+    const uint data_size = 32;
+    for (uint period : {1, 10, 20, 40, 80, 160})
+        cout << "main loop every " << period << " byte times: " << run(period, 1000, data_size) * 100 << "% line utilization" << endl;
+
+    return 0;
+}
@@ -3,12 +3,36 @@
 #include <libprotoserial/fragmentation.hpp>
 #include <libprotoserial/ports/packet.hpp>
 #include <libprotoserial/protostacks.hpp>
+#include <libprotoserial/routing/router.hpp>
+#include <libprotoserial/services/built_in/rpc.hpp>
+#include <libprotoserial/services/built_in/link_control.hpp>
+#include <libprotoserial/services/built_in/pubsub.hpp>
+#include <libprotoserial/utils/executor.hpp>
+#include <libprotoserial/utils/reactor.hpp>
+#include <libprotoserial/utils/trace.hpp>
+#include <libprotoserial/serializer.hpp>
 
 #include "helpers/random.hpp"
 #include "helpers/testers.hpp"
+#include "helpers/stm32_hal.hpp"
+/* the STM32 drivers build against the HAL stand-in */
+#include <libprotoserial/interface/stm32/uart.hpp>
 
 #include <map>
 #include <tuple>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <sstream>
+#include <optional>
+#include <algorithm>
+#include <span>
+
+#ifdef SP_LINUX
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#endif
 
 #include "gtest/gtest.h"
 
@@ -346,6 +370,502 @@ TEST(Bytes, Shrink)
 
 
 
+struct observer_tester
+{
+    void callback(int a, int b) {sum += a + b;}
+    void watch_callback() {watched++;}
+    int sum = 0, watched = 0;
+};
+
+TEST(Observer, SubscribeUnsubscribe)
+{
+    sp::subject<int, int> s;
+    observer_tester o1, o2;
+    int lambda_sum = 0;
+
+    auto s1 = s.subscribe(&observer_tester::callback, &o1);
+    auto s2 = s.subscribe<&observer_tester::callback>(&o2);
+    auto s3 = s.subscribe([&](int a, int b){lambda_sum += a * b;});
+    s.watch(&observer_tester::watch_callback, &o1);
+
+    s.emit(2, 3);
+    EXPECT_EQ(o1.sum, 5);
+    EXPECT_EQ(o2.sum, 5);
+    EXPECT_EQ(lambda_sum, 6);
+    EXPECT_EQ(o1.watched, 1);
+
+    s.unsubscribe(s2);
+    s.unsubscribe(s3);
+    s.emit(1, 1);
+    EXPECT_EQ(o1.sum, 7);
+    EXPECT_EQ(o2.sum, 5);
+    EXPECT_EQ(lambda_sum, 6);
+    EXPECT_EQ(o1.watched, 2);
+
+    s.unsubscribe(s1);
+    s.emit(1, 1);
+    EXPECT_EQ(o1.sum, 7);
+}
+
+TEST(Observer, FanOut)
+{
+    struct counted
+    {
+        counted(sp::bytes b) : data(std::move(b)) {}
+        counted(const counted & other) : data(other.data), copies(other.copies + 1) {}
+        counted(counted &&) = default;
+        sp::bytes data;
+        int copies = 0;
+    };
+
+    const sp::bytes bc = {1_BYTE, 2_BYTE, 3_BYTE};
+    sp::subject<counted> s;
+    std::vector<counted> by_value;
+    int total_copies = 0;
+
+    /* a single subscriber gets the moved object */
+    s.subscribe([&](counted c){total_copies += c.copies; by_value.push_back(std::move(c));});
+    s.emit(counted(bc));
+    EXPECT_EQ(total_copies, 0);
+
+    /* by value subscribers before the last one need their own copy, const reference subscribers do not, 
+    and nobody may see a moved-from object */
+    s.subscribe([&](const counted & c){total_copies += c.copies; EXPECT_TRUE(c.data == bc);});
+    s.subscribe([&](counted && c){total_copies += c.copies; by_value.push_back(std::move(c));});
+    s.emit(counted(bc));
+    EXPECT_EQ(total_copies, 1);
+    ASSERT_EQ(by_value.size(), 3);
+    for (const auto & c : by_value)
+        EXPECT_TRUE(c.data == bc) << c.data;
+}
+
+TEST(Observer, Delegate)
+{
+    /* large captures do not fit the inline buffer, they must still work */
+    std::array<int, 32> big{};
+    big[31] = 10;
+    int result = 0;
+    sp::delegate<void(int)> d1([big, &result](int a){result = a + big[31];});
+    sp::delegate<void(int)> d2(std::move(d1));
+    EXPECT_FALSE(d1);
+    ASSERT_TRUE(d2);
+    d2(5);
+    EXPECT_EQ(result, 15);
+
+    sp::delegate<void(int)> d3(std::function<void(int)>{});
+    EXPECT_FALSE(d3);
+
+    std::vector<sp::delegate<void(int)>> v;
+    for (int i = 0; i < 100; i++)
+        v.emplace_back([&result, i](int a){result += i * a;});
+    result = 0;
+    for (auto & d : v)
+        d(1);
+    EXPECT_EQ(result, 4950);
+}
+
+TEST(Observer, UnsubscribeWithinEmit)
+{
+    sp::subject<int> s;
+    int a = 0, b = 0;
+    sp::subscription sa;
+    sa = s.subscribe([&](int v){a += v; s.unsubscribe(sa);});
+    s.subscribe([&](int v){b += v;});
+
+    /* the emit in progress still calls everybody, the next one does not call a */
+    s.emit(1);
+    s.emit(1);
+    EXPECT_EQ(a, 1);
+    EXPECT_EQ(b, 2);
+}
+
+#ifdef SP_THREADS
+/* build with -fsanitize=thread to check the subscription management for data races */
+TEST(Observer, ConcurrentSubscribe)
+{
+    sp::subject<int> s;
+    std::atomic<long> sum = 0;
+    std::atomic<bool> stop = false;
+    s.subscribe([&](int v){sum += v;});
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; t++)
+        threads.emplace_back([&]{
+            for (int i = 0; i < 2000; i++)
+                s.unsubscribe(s.subscribe([&](int v){sum += v;}));
+        });
+    for (int t = 0; t < 2; t++)
+        threads.emplace_back([&]{
+            while (!stop)
+                s.emit(0);
+        });
+    
+    for (int t = 0; t < 2; t++)
+        threads[t].join();
+    stop = true;
+    for (int t = 2; t < 4; t++)
+        threads[t].join();
+    
+    /* only the permanent subscriber is left */
+    s.emit(1);
+    EXPECT_EQ(sum, 1);
+}
+#endif
+
+/* the snapshots replaced by unsubscribe hold copies of the subscribers, the token's use count 
+tells how many of them are still around */
+TEST(Observer, ReclaimAfterThrow)
+{
+    sp::subject<int> s;
+    auto token = std::make_shared<int>(0);
+    auto thrower = s.subscribe([](int){throw 1;});
+    s.subscribe([token](int){});
+
+    EXPECT_THROW(s.emit(0), int);
+    s.unsubscribe(thrower);
+    EXPECT_EQ(token.use_count(), 2);
+}
+
+#ifdef SP_THREADS
+/* two threads keep emitting so that there is always an emit in progress, each emit 
+waits until it is released, the retired snapshots must be freed nonetheless */
+TEST(Observer, ReclaimWhileEmitting)
+{
+    const int count = 200;
+    sp::subject<int> s;
+    auto token = std::make_shared<int>(0);
+    std::atomic<int> entered = 0, released = -1;
+    s.subscribe([&](int id){
+        entered++;
+        while (released < id)
+            std::this_thread::yield();
+    });
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; t++)
+        threads.emplace_back([&, t]{
+            for (int id = t; id < count + 2; id += 2)
+                s.emit(id);
+        });
+
+    long max_copies = 0;
+    for (int id = 0; id < count; id++)
+    {
+        /* emits id and id + 1 are both in progress */
+        while (entered < id + 2)
+            std::this_thread::yield();
+        s.unsubscribe(s.subscribe([token](int){}));
+        max_copies = std::max<long>(max_copies, token.use_count());
+        released = id;
+    }
+    released = count + 2;
+    for (auto & t : threads)
+        t.join();
+
+    EXPECT_LT(max_copies, 10);
+    EXPECT_EQ(token.use_count(), 1);
+}
+#endif
+
+
+
+
+
+TEST(Executor, RunLoop)
+{
+    sp::run_loop loop(16);
+    sp::deferred_subject<sp::bytes> s(loop, 3);
+    std::vector<sp::bytes> received;
+    s.subscribe([&](sp::bytes b){received.push_back(std::move(b));});
+
+    for (int i = 0; i < 5; i++)
+        s.emit(sp::bytes{(sp::byte)i});
+    
+    /* nothing happens until the loop runs, only max_pending events fit */
+    EXPECT_TRUE(received.empty());
+    auto stats = s.get_statistics();
+    EXPECT_EQ(stats.posted, 3);
+    EXPECT_EQ(stats.dropped, 2);
+    EXPECT_EQ(stats.pending, 3);
+
+    EXPECT_EQ(loop.poll(), 3);
+    ASSERT_EQ(received.size(), 3);
+    for (int i = 0; i < 3; i++)
+        EXPECT_TRUE(received[i] == sp::bytes{(sp::byte)i});
+    
+    stats = s.get_statistics();
+    EXPECT_EQ(stats.dispatched, 3);
+    EXPECT_EQ(stats.pending, 0);
+    EXPECT_TRUE(stats.max_latency >= stats.average_latency());
+
+    s.emit_now(sp::bytes{10_BYTE});
+    EXPECT_EQ(received.size(), 4);
+}
+
+namespace deferred_service_test
+{
+    struct service : public sp::port_service_base
+    {
+        void receive_callback(sp::packet p) {received.push_back(std::move(p));}
+        std::vector<sp::packet> received;
+    };
+}
+
+/* a service bound to an executor gets its packets once the executor runs */
+TEST(Executor, DeferredService)
+{
+    sp::run_loop loop(16);
+    sp::ports_handler ports;
+    deferred_service_test::service s;
+    s.bind_to(ports, 4, loop, 2);
+
+    /* whatever the ports_handler transmits comes right back */
+    sp::interface_identifier iid(sp::interface_identifier::identifier_type::LOOPBACK, 130);
+    auto & ie = ports.register_interface(iid);
+    ie.transfer_transmit_event.subscribe([&](sp::transfer t){ie.transfer_receive_callback(std::move(t));});
+
+    for (int i = 0; i < 3; i++)
+    {
+        sp::transfer t(sp::transfer_metadata(0, 1, iid, sp::fragment_metadata::stamp(), 1, 0), sp::bytes(3));
+        ports.transmit(5, sp::packet(std::move(t), 5, 4));
+    }
+    EXPECT_TRUE(s.received.empty());
+    EXPECT_EQ(s.get_deferred_statistics().posted, 2);
+    EXPECT_EQ(s.get_deferred_statistics().dropped, 1);
+
+    EXPECT_EQ(loop.poll(), 2);
+    ASSERT_EQ(s.received.size(), 2);
+    EXPECT_EQ(s.received[0].source_port(), 5);
+    EXPECT_EQ(s.received[0].destination_port(), 4);
+    EXPECT_EQ(s.received[0].data().size(), 3);
+    EXPECT_EQ(s.get_deferred_statistics().pending, 0);
+}
+
+#ifdef SP_THREADS
+TEST(Executor, ThreadPool)
+{
+    std::atomic<int> sum = 0;
+    {
+        sp::thread_pool pool(4, 1024);
+        sp::deferred_subject<int> s(pool, 1024);
+        s.subscribe([&](int v){sum += v;});
+
+        int expected = 0;
+        for (int i = 0; i < 10000; i++)
+        {
+            while (!s.emit(i))
+                std::this_thread::yield();
+            expected += i;
+        }
+        while (s.get_statistics().pending)
+            std::this_thread::yield();
+        EXPECT_EQ(sum, expected);
+    }
+}
+#endif
+
+#ifdef SP_THREADS
+TEST(Reactor, PinnedStacks)
+{
+    struct counting_stack
+    {
+        void main_task()
+        {
+            std::thread::id none;
+            if (!owner.compare_exchange_strong(none, std::this_thread::get_id()) && none != std::this_thread::get_id())
+                foreign = true;
+            ++calls;
+        }
+        std::atomic<std::thread::id> owner;
+        std::atomic<int> calls = 0;
+        std::atomic<bool> foreign = false;
+    };
+
+    std::array<counting_stack, 8> stacks;
+    std::atomic<int> delivered = 0;
+    std::thread::id cross_thread;
+    {
+        sp::reactor r(3, 64);
+        for (auto & s : stacks)
+            r.attach(s);
+        EXPECT_EQ(r.get_worker(0).size(), 3);
+        EXPECT_EQ(r.get_worker(2).size(), 2);
+
+        /* events for a stack on another worker cross over through the worker's inbox */
+        sp::deferred_subject<int> cross(r.worker_of(stacks[1]), 64);
+        cross.subscribe([&](int v){
+            cross_thread = std::this_thread::get_id();
+            delivered += v;
+        });
+
+        r.start();
+        for (int i = 0; i < 100; i++)
+            while (!cross.emit(1))
+                std::this_thread::yield();
+        while (delivered < 100 || std::any_of(stacks.begin(), stacks.end(), [](auto & s){return s.calls < 10;}))
+            std::this_thread::yield();
+        r.stop();
+    }
+
+    for (auto & s : stacks)
+        EXPECT_FALSE(s.foreign);
+    EXPECT_EQ(cross_thread, stacks[1].owner.load());
+    EXPECT_NE(stacks[0].owner.load(), stacks[1].owner.load());
+}
+#endif
+
+#ifdef SP_THREADS
+/* transfers of one interface may be created on any thread, the IDs must still be unique */
+TEST(Reactor, SharedTransferIds)
+{
+    sp::interface_identifier iid(sp::interface_identifier::identifier_type::LOOPBACK, 42);
+    std::array<std::vector<sp::id_factory::id_type>, 4> ids;
+    std::vector<std::thread> threads;
+    for (auto & v : ids)
+        threads.emplace_back([&]{
+            for (int i = 0; i < 1000; i++)
+                v.push_back(sp::global_id_factory.new_id(iid));
+        });
+    for (auto & t : threads)
+        t.join();
+
+    std::vector<sp::id_factory::id_type> all;
+    for (auto & v : ids)
+        all.insert(all.end(), v.begin(), v.end());
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(std::adjacent_find(all.begin(), all.end()), all.end());
+    EXPECT_EQ(std::count_if(all.begin(), all.end(), [](auto id){return (std::uint8_t)id == 0;}), 0);
+}
+#endif
+
+TEST(Trace, ChromeExport)
+{
+    auto r = std::make_shared<sp::trace::ring>(4, 7);
+    for (std::uint32_t i = 0; i < 6; i++)
+        r->record("step", i, i % 2 ? sp::trace::event::END : sp::trace::event::BEGIN);
+    r->record("mark", 42, sp::trace::event::INSTANT);
+
+    /* only the most recent events are kept */
+    auto events = r->snapshot();
+    ASSERT_EQ(events.size(), 4);
+    EXPECT_EQ(r->recorded(), 7);
+    EXPECT_EQ(events.front().id, 3);
+    EXPECT_EQ(events.back().id, 42);
+    for (std::size_t i = 1; i < events.size(); i++)
+        EXPECT_LE(events[i - 1].timestamp, events[i].timestamp);
+
+    std::stringstream s;
+    sp::trace::export_chrome(s, {r});
+    auto json = s.str();
+    EXPECT_EQ(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["), 0);
+    EXPECT_NE(json.find("\"name\":\"mark\",\"ph\":\"i\""), std::string::npos);
+    EXPECT_NE(json.find("\"tid\":7"), std::string::npos);
+    EXPECT_NE(json.find("\"args\":{\"id\":42}"), std::string::npos);
+    EXPECT_EQ(json.substr(json.size() - 4), "\n]}\n");
+}
+
+namespace serializer_test
+{
+    namespace ser = sp::serializer;
+    enum class mode : std::uint8_t {idle = 1, active = 7};
+    struct status
+    {
+        mode m;
+        std::int16_t temperature;
+        std::string name;
+        float ratio;
+        std::uint32_t uptime;
+    };
+    using status_v1 = ser::schema<status, 1, ser::field<&status::m>, ser::field<&status::temperature>, 
+        ser::blob_field<&status::name>, ser::field<&status::ratio>>;
+    using status_v2 = ser::schema<status, 2, ser::field<&status::m>, ser::field<&status::temperature>, 
+        ser::blob_field<&status::name>, ser::field<&status::ratio>, ser::since<2, ser::field<&status::uptime>>>;
+
+    struct point {std::int32_t x, y;};
+    using point_schema = ser::schema<point, 0, ser::field<&point::x>, ser::field<&point::y>>;
+    static_assert(point_schema::is_fixed && point_schema::fixed_size == 9);
+
+    constexpr std::int32_t constexpr_roundtrip()
+    {
+        std::array<sp::byte, point_schema::fixed_size> a{};
+        point_schema::encode(point{-2, 300}, a.data());
+        return point_schema::parse(a.data(), a.size())->get<&point::y>();
+    }
+    static_assert(constexpr_roundtrip() == 300);
+}
+
+TEST(Serializer, Roundtrip)
+{
+    using namespace serializer_test;
+    status s{mode::active, -40, "sensor", 2.5f, 123456};
+    auto b = status_v2::to_bytes(s, sp::prealloc_size(4, 4));
+    EXPECT_EQ(b.size(), status_v2::wire_size(s));
+
+    auto v = status_v2::parse(b);
+    ASSERT_TRUE(v);
+    EXPECT_EQ(v->version(), 2);
+    EXPECT_EQ(v->get<&status::m>(), mode::active);
+    EXPECT_EQ(v->get<&status::temperature>(), -40);
+    EXPECT_EQ(v->get<&status::name>(), "sensor");
+    EXPECT_EQ(v->get<&status::ratio>(), 2.5f);
+    EXPECT_EQ(v->get<&status::uptime>(), 123456);
+    /* the view points into the buffer */
+    EXPECT_EQ((const void*)v->get<&status::name>().data(), (const void*)(b.data() + 5));
+
+    auto d = status_v2::decode(b);
+    ASSERT_TRUE(d);
+    EXPECT_EQ(d->name, "sensor");
+    EXPECT_EQ(d->uptime, 123456);
+
+    /* truncated message */
+    EXPECT_FALSE(status_v2::parse(b.sub(0, 6)));
+}
+
+TEST(Serializer, Versioning)
+{
+    using namespace serializer_test;
+    status s{mode::idle, 20, "n", 0.5f, 99};
+
+    /* older decoder skips the fields it does not know */
+    auto old = status_v1::decode(status_v2::to_bytes(s));
+    ASSERT_TRUE(old);
+    EXPECT_EQ(old->name, "n");
+    EXPECT_EQ(old->uptime, 0);
+
+    /* newer decoder sees the missing fields as defaults */
+    auto b = status_v1::to_bytes(s);
+    auto v = status_v2::parse(b);
+    ASSERT_TRUE(v);
+    EXPECT_FALSE(v->has<&status::uptime>());
+    EXPECT_EQ(v->get<&status::uptime>(), 0);
+    EXPECT_EQ(v->get<&status::ratio>(), 0.5f);
+}
+
+/* every fragment and transfer in flight carries its metadata, keep them from growing unnoticed */
+TEST(Metadata, SizeBudget)
+{
+#ifndef SP_NO_TIMESTAMPS
+    constexpr size_t timestamp = sizeof(sp::clock::time_point);
+#else
+    constexpr size_t timestamp = 0;
+#endif
+    EXPECT_LE(sizeof(sp::fragment_metadata), timestamp + 8);
+    /* the transfer IDs live in the fragment_metadata's tail padding */
+    EXPECT_LE(sizeof(sp::transfer_metadata), timestamp + 8);
+    EXPECT_LE(sizeof(sp::packet_metadata), timestamp + 16);
+    EXPECT_LE(sizeof(sp::fragment), timestamp + 16 + sizeof(sp::fragment::data_type));
+    EXPECT_LE(sizeof(sp::transfer), timestamp + 16 + sizeof(sp::transfer::data_type));
+
+    sp::fragment f(1, 2, sp::bytes(4), sp::interface_identifier(sp::interface_identifier::VIRTUAL, 0));
+    EXPECT_EQ(f.source(), 1);
+    EXPECT_EQ(f.destination(), 2);
+#ifndef SP_NO_TIMESTAMPS
+    EXPECT_NE(f.timestamp_creation(), sp::never());
+#else
+    EXPECT_EQ(f.timestamp_creation(), sp::never());
+#endif
+}
+
 TEST(Interface, CircularIterator)
 {
     sp::bytes b(10);
@@ -440,6 +960,494 @@ TEST(Interface, HeavilyCorruptedRandom)
 }
 
 
+namespace batch_test
+{
+    /* exposes do_receive so that a single receive pass can be triggered */
+    struct interface : public sp::virtual_interface
+    {
+        using sp::virtual_interface::virtual_interface;
+        using sp::virtual_interface::do_receive;
+        using sp::virtual_interface::put_received;
+    };
+}
+
+TEST(Interface, ReceiveBatch)
+{
+    batch_test::interface a(0, 1, 255, 10, 64, 1024), b(1, 2, 255, 10, 64, 1024);
+    vector<size_t> batches;
+    uint single = 0, other = 0;
+    b.receive_batch_event.subscribe([&](span<sp::fragment> batch){
+        batches.push_back(batch.size());
+        for (auto & f : batch)
+            EXPECT_EQ(f.destination(), 2);
+    });
+    b.other_receive_event.subscribe([&](sp::fragment f){other++;});
+
+    auto send = [&](sp::interface::address_type dst, uint count){
+        for (uint i = 0; i < count; i++)
+            a.transmit(sp::fragment(dst, sp::bytes(8)));
+        for (uint i = 0; i < count; i++)
+            a.main_task();
+        while (a.has_serialized())
+            b.put_serialized(a.get_serialized());
+    };
+
+    /* all the complete fragments come out of a single pass */
+    send(2, 3);
+    send(3, 1);
+    b.do_receive();
+    ASSERT_EQ(batches.size(), 1);
+    EXPECT_EQ(batches[0], 3);
+    EXPECT_EQ(other, 1);
+
+    /* receive_event subscribers still see every fragment */
+    b.receive_event.subscribe([&](sp::fragment f){single++;});
+    send(2, 2);
+    b.do_receive();
+    ASSERT_EQ(batches.size(), 2);
+    EXPECT_EQ(batches[1], 2);
+    EXPECT_EQ(single, 2);
+}
+
+/* the fragments come out in the order they were received, interfaces which deliver them
+one by one still feed the batch subscribers */
+TEST(Interface, ReceiveBatchOrder)
+{
+    batch_test::interface i(0, 2, 255, 10, 64, 1024);
+    vector<sp::interface::address_type> order;
+    i.receive_batch_event.subscribe([&](span<sp::fragment> batch){
+        for (auto & f : batch)
+            order.push_back(f.source());
+    });
+    i.other_receive_event.subscribe([&](sp::fragment f){order.push_back(f.source());});
+
+    vector<sp::fragment> batch;
+    for (sp::interface::address_type src : {1, 3, 4, 5})
+        batch.emplace_back(src, src == 3 ? 6 : 2, sp::bytes(4), i.interface_id());
+    i.put_received(span<sp::fragment>(batch));
+    EXPECT_TRUE(order == vector<sp::interface::address_type>({1, 3, 4, 5}));
+
+    order.clear();
+    i.put_received(sp::fragment(7, 2, sp::bytes(4), i.interface_id()));
+    EXPECT_TRUE(order == vector<sp::interface::address_type>({7}));
+}
+
+/* a subscriber which moves the fragments out does not take them from the next one */
+TEST(Interface, ReceiveBatchShared)
+{
+    batch_test::interface i(0, 2, 255, 10, 64, 1024);
+    vector<sp::fragment> batch;
+    for (sp::interface::address_type src : {1, 3})
+        batch.emplace_back(src, 2, sp::bytes(4), i.interface_id());
+
+    const sp::fragment * seen = nullptr;
+    vector<sp::fragment> first, last;
+    /* read only, gets the fragments themselves */
+    i.receive_batch_event.subscribe([&](span<const sp::fragment> b){seen = b.data();});
+    /* not the last one, gets copies */
+    i.receive_batch_event.subscribe([&](span<sp::fragment> b){
+        EXPECT_NE(b.data(), batch.data());
+        for (auto & f : b)
+            first.push_back(std::move(f));
+    });
+    i.receive_batch_event.subscribe([&](span<sp::fragment> b){
+        EXPECT_EQ(b.data(), batch.data());
+        for (auto & f : b)
+            last.push_back(std::move(f));
+    });
+
+    i.put_received(span<sp::fragment>(batch));
+    EXPECT_EQ(seen, batch.data());
+    ASSERT_EQ(first.size(), 2);
+    ASSERT_EQ(last.size(), 2);
+    for (size_t n = 0; n < 2; n++)
+    {
+        EXPECT_EQ(first[n].data().size(), 4);
+        EXPECT_EQ(last[n].data().size(), 4);
+        EXPECT_EQ(last[n].source(), first[n].source());
+    }
+}
+
+namespace filter_test
+{
+    struct interface : public sp::virtual_interface
+    {
+        using sp::virtual_interface::virtual_interface;
+        using sp::virtual_interface::do_receive;
+        using sp::virtual_interface::serialize_fragment;
+    };
+}
+
+/* a foreign fragment followed by another one is skipped as a whole when nobody listens to 
+other_receive_event, its hash is not even checked, so a fragment hidden in its data is never found */
+TEST(Interface, EarlyAddressFilter)
+{
+    filter_test::interface a(0, 1, 255, 10, 64, 1024), b(1, 2, 255, 10, 64, 1024);
+    auto foreign = [&]{
+        auto inner = a.serialize_fragment(sp::fragment(1, 2, sp::bytes(8), a.interface_id()));
+        auto outer = a.serialize_fragment(sp::fragment(1, 3, std::move(inner), a.interface_id()));
+        outer[outer.size() - 1] = ~outer[outer.size() - 1];
+        outer.push_back(a.serialize_fragment(sp::fragment(1, 2, sp::bytes(4), a.interface_id())));
+        return outer;
+    };
+    uint received = 0, other = 0;
+    b.receive_event.subscribe([&](sp::fragment f){received++;});
+
+    b.put_serialized(foreign());
+    EXPECT_EQ(b.do_receive(), 0);
+    EXPECT_EQ(received, 1);
+
+    /* with a subscriber the fragment is parsed, it fails the hash check and the one inside is found */
+    b.other_receive_event.subscribe([&](sp::fragment f){other++;});
+    b.put_serialized(foreign());
+    EXPECT_EQ(b.do_receive(), 0);
+    EXPECT_EQ(received, 3);
+    EXPECT_EQ(other, 0);
+}
+
+/* noise which passes the Header check must not make the parser skip the valid fragment behind it */
+TEST(Interface, EarlyAddressFilterNoise)
+{
+    filter_test::interface a(0, 1, 255, 10, 64, 1024), b(1, 2, 255, 10, 64, 1024);
+    uint received = 0;
+    b.receive_event.subscribe([&](sp::fragment f){received++;});
+
+    /* preamble and a Header for 9 from 8 with 20 bytes of data, which covers the fragment after it */
+    sp::bytes noise = {0x55_BYTE, 9_BYTE, 8_BYTE, 20_BYTE, 37_BYTE};
+    auto valid = a.serialize_fragment(sp::fragment(1, 2, sp::bytes(8), a.interface_id()));
+    b.put_serialized(std::move(noise));
+    b.put_serialized(std::move(valid));
+    b.put_serialized(sp::bytes(7));
+    b.do_receive();
+    EXPECT_EQ(received, 1);
+}
+
+namespace serialize_test
+{
+    /* exposes both serialization paths */
+    struct interface : public sp::virtual_interface
+    {
+        using sp::virtual_interface::virtual_interface;
+        using sp::virtual_interface::serialize_fragment;
+        using sp::virtual_interface::serialize_into;
+        using sp::virtual_interface::serialized_size;
+    };
+}
+
+/* the driver buffer path must produce exactly what serialize_fragment does */
+TEST(Interface, SerializeInto)
+{
+    serialize_test::interface i(0, 1, 255, 10, 64, 256);
+    sp::bytes data(20);
+    for (uint j = 0; j < data.size(); j++)
+        data[j] = (sp::byte)(j * 7);
+    sp::fragment f(1, 2, std::move(data), i.interface_id());
+
+    sp::bytes out(i.serialized_size(f));
+    EXPECT_EQ(i.serialize_into(f, out.data()), out.size());
+    EXPECT_TRUE(out == i.serialize_fragment(sp::fragment(f)));
+}
+
+#ifdef SP_LINUX
+namespace uring_test
+{
+#ifdef SP_IO_URING
+    struct interface : public sp::uring_uart_interface
+    {
+        using sp::uring_uart_interface::uring_uart_interface;
+        using sp::uring_uart_interface::do_receive;
+        using sp::uring_uart_interface::serialize_fragment;
+    };
+#endif
+
+    /* the master side of a pty pair, the interface opens the slave */
+    struct pty
+    {
+        pty() : master(posix_openpt(O_RDWR | O_NOCTTY))
+        {
+            grantpt(master);
+            unlockpt(master);
+            /* raw mode, the line discipline must not touch the bytes */
+            termios tty;
+            tcgetattr(master, &tty);
+            cfmakeraw(&tty);
+            tcsetattr(master, TCSANOW, &tty);
+        }
+        ~pty() {close(master);}
+        std::string slave() const {return ptsname(master);}
+
+        int master;
+    };
+}
+
+#ifdef SP_IO_URING
+/* a pty pair stands in for the serial port */
+TEST(Interface, UringUartPty)
+{
+    uring_test::pty pty;
+    sp::io_ring ring;
+    uring_test::interface i(ring, pty.slave(), B115200, 0, 1, 255, 10, 64, 1024);
+
+    /* receive, the fragments are written into the master side in one go */
+    uint received = 0;
+    i.receive_event.subscribe([&](sp::fragment f){
+        EXPECT_EQ(f.source(), 2);
+        EXPECT_EQ(f.data().size(), 10);
+        received++;
+    });
+    sp::bytes serialized;
+    for (int n = 0; n < 5; n++)
+        serialized.push_back(i.serialize_fragment(sp::fragment(2, 1, sp::bytes(10), i.interface_id())));
+    ASSERT_EQ(write(pty.master, serialized.data(), serialized.size()), (ssize_t)serialized.size());
+
+    auto rounds = 0;
+    for (; rounds < 1000 && received < 5; rounds++)
+    {
+        ring.main_task();
+        i.do_receive();
+        if (received < 5)
+            ring.wait();
+    }
+    EXPECT_EQ(received, 5);
+    /* the reads and their completions are batched, there is not one syscall per fragment */
+    EXPECT_LE(ring.syscall_count(), 2u * rounds + 1);
+
+    /* transmit */
+    i.transmit(sp::fragment(2, sp::bytes(10)));
+    for (int n = 0; n < 10 && i.has_work(); n++)
+    {
+        i.main_task();
+        ring.main_task();
+    }
+    pollfd pfd{pty.master, POLLIN, 0};
+    ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+    uint8_t buff[64];
+    auto got = read(pty.master, buff, sizeof(buff));
+    EXPECT_EQ(got, (ssize_t)(10 + i.overhead_size()));
+}
+
+/* a failed write drops the fragment, it shows in the statistics and the next one still goes out */
+TEST(Interface, UringUartWriteError)
+{
+    std::optional<uring_test::pty> pty(std::in_place);
+    sp::io_ring ring;
+    uring_test::interface i(ring, pty->slave(), B115200, 0, 1, 255, 10, 64, 1024);
+    /* the slave fails with EIO once the master is gone */
+    pty.reset();
+
+    i.transmit(sp::fragment(2, sp::bytes(10)));
+    i.transmit(sp::fragment(2, sp::bytes(10)));
+    for (int n = 0; n < 10 && (i.has_work() || i.get_statistics().transmit_errors < 2); n++)
+    {
+        i.main_task();
+        ring.main_task();
+    }
+    EXPECT_FALSE(i.has_work());
+    EXPECT_EQ(i.get_statistics().transmit_errors, 2);
+}
+#endif
+
+TEST(Interface, UartSerialConfig)
+{
+    uring_test::pty pty;
+    sp::uart_interface::serial_config config{250000, true, true};
+    sp::uart_interface i(pty.slave(), config, 0, 1, 255, 10, 64, 1024);
+
+    termios tty;
+    ASSERT_EQ(tcgetattr(i.native_handle(), &tty), 0);
+    EXPECT_TRUE(tty.c_cflag & CRTSCTS);
+
+    /* a pty has no serial_struct, low_latency is refused, which is only reported */
+    EXPECT_FALSE(i.configure(config));
+    config.low_latency = false;
+    config.flow_control = false;
+    EXPECT_TRUE(i.configure(config));
+    ASSERT_EQ(tcgetattr(i.native_handle(), &tty), 0);
+    EXPECT_FALSE(tty.c_cflag & CRTSCTS);
+}
+#endif
+
+namespace stm32_test
+{
+    struct uart : public sp::detail::stm32::uart_interface<sp::headers::interface_8b8b, sp::footers::crc32>
+    {
+        uart(UART_HandleTypeDef * h) :
+            sp::detail::stm32::uart_interface<sp::headers::interface_8b8b, sp::footers::crc32>(h, 0, 1, 255, 4, 64, 256) {}
+
+        sp::prealloc_size minimum_prealloc() const noexcept {return sp::prealloc_size();}
+        using sp::detail::stm32::uart_interface<sp::headers::interface_8b8b, sp::footers::crc32>::do_receive;
+    };
+}
+
+/* a transmit the HAL refuses frees its buffer, the next fragments still go out */
+TEST(Interface, Stm32UartTransmitError)
+{
+    UART_HandleTypeDef huart;
+    stm32_test::uart u(&huart);
+    huart.tx_complete = [&]{u.isr_tx_done();};
+
+    huart.tx_status = HAL_ERROR;
+    u.transmit(sp::fragment(2, sp::bytes(10)));
+    u.main_task();
+    EXPECT_FALSE(u.is_transmitting());
+    EXPECT_TRUE(u.can_transmit());
+    EXPECT_EQ(u.get_statistics().transmit_errors, 1);
+
+    /* the second fragment waits in the other buffer, chaining it from the interrupt fails */
+    huart.tx_status = HAL_OK;
+    u.transmit(sp::fragment(2, sp::bytes(10)));
+    u.main_task();
+    u.transmit(sp::fragment(2, sp::bytes(10)));
+    u.main_task();
+    EXPECT_TRUE(u.is_transmitting());
+    huart.tx_status = HAL_BUSY;
+    for (int n = 0; n < 100 && huart.tx_remaining; n++)
+        huart.tick();
+    EXPECT_EQ(huart.line.size(), 10 + u.overhead_size());
+    EXPECT_FALSE(u.is_transmitting());
+    EXPECT_TRUE(u.can_transmit());
+    EXPECT_EQ(u.get_statistics().transmit_errors, 2);
+
+    huart.tx_status = HAL_OK;
+    u.transmit(sp::fragment(2, sp::bytes(10)));
+    u.main_task();
+    for (int n = 0; n < 100 && huart.tx_remaining; n++)
+        huart.tick();
+    EXPECT_EQ(huart.line.size(), 2 * (10 + u.overhead_size()));
+    EXPECT_FALSE(u.is_transmitting());
+}
+
+/* a fragment waiting for a free buffer is no work, the TX complete interrupt wakes the loop */
+TEST(Interface, Stm32UartHasWork)
+{
+    UART_HandleTypeDef huart;
+    stm32_test::uart u(&huart);
+    huart.tx_complete = [&]{u.isr_tx_done();};
+    /* the byte handed to the HAL to receive into counts until do_receive has seen it */
+    u.do_receive();
+
+    for (int i = 0; i < 3; i++)
+        u.transmit(sp::fragment(2, sp::bytes(10)));
+    EXPECT_TRUE(u.has_work());
+    u.main_task();
+    u.main_task();
+    /* one buffer is being sent, the other one waits for it */
+    EXPECT_FALSE(u.can_transmit());
+    EXPECT_FALSE(u.has_work());
+
+    for (int n = 0; n < 100 && !u.can_transmit(); n++)
+        huart.tick();
+    EXPECT_TRUE(u.has_work());
+    u.main_task();
+    EXPECT_FALSE(u.has_work());
+}
+
+namespace router_test
+{
+    struct interface : public sp::virtual_interface
+    {
+        using sp::virtual_interface::virtual_interface;
+        using sp::virtual_interface::do_receive;
+    };
+
+    /* moves everything serialized by src into dst and parses it there */
+    void pump(interface & src, interface & dst)
+    {
+        while (src.has_serialized())
+            dst.put_serialized(src.get_serialized());
+        dst.do_receive();
+    }
+
+    /*
+     *   a (1) --- bus 0 --- (10) g0 | g1 (11) --- bus 1 --- (3) b
+     */
+    struct network
+    {
+        network()
+        {
+            r.add_interface(g0);
+            r.add_interface(g1);
+            b.receive_event.subscribe([this](sp::fragment f){received.push_back(std::move(f));});
+            b.other_receive_event.subscribe([this](sp::fragment f){received.push_back(std::move(f));});
+        }
+
+        /* a sends size bytes to dst, everything the gateway forwards ends up in received */
+        void send(sp::interface::address_type dst, uint size)
+        {
+            a.transmit(sp::fragment(dst, sp::bytes(size)));
+            a.main_task();
+            pump(a, g0);
+            g1.main_task();
+            pump(g1, b);
+        }
+
+        /* g1 takes fragments of at most 32 bytes */
+        interface a{0, 1, 255, 16, 64, 1024}, g0{1, 10, 255, 16, 64, 1024};
+        interface g1{2, 11, 255, 16, 32, 1024}, b{3, 3, 255, 16, 64, 1024};
+        sp::router r;
+        std::vector<sp::fragment> received;
+    };
+}
+
+TEST(Router, Forward)
+{
+    router_test::network n;
+    n.r.add_route(3, n.g1);
+    n.send(3, 10);
+
+    ASSERT_EQ(n.received.size(), 1);
+    /* the fragment keeps the address of its sender, not the gateway's */
+    EXPECT_EQ(n.received[0].source(), 1);
+    EXPECT_EQ(n.received[0].destination(), 3);
+    EXPECT_EQ(n.received[0].data().size(), 10);
+    EXPECT_EQ(n.received[0].interface_id(), n.b.interface_id());
+    EXPECT_EQ(n.r.get_statistics().forwarded, 1);
+}
+
+TEST(Router, Outcomes)
+{
+    router_test::network n;
+    n.send(3, 10);
+    EXPECT_EQ(n.r.get_statistics().no_route, 1);
+
+    /* the route leads back onto bus 0 */
+    n.r.add_route(3, n.g0);
+    n.send(3, 10);
+    EXPECT_EQ(n.r.get_statistics().same_interface, 1);
+
+    /* too large for g1 */
+    n.r.add_route(3, n.g1);
+    n.send(3, 40);
+    EXPECT_EQ(n.r.get_statistics().rejected, 1);
+
+    n.r.remove_route(3);
+    n.send(3, 10);
+    EXPECT_EQ(n.r.get_statistics().no_route, 2);
+    EXPECT_EQ(n.r.get_statistics().forwarded, 0);
+    EXPECT_TRUE(n.received.empty());
+}
+
+TEST(Router, DefaultRoute)
+{
+    router_test::network n;
+    n.r.set_default_route(&n.g1);
+    n.send(5, 10);
+    ASSERT_EQ(n.received.size(), 1);
+    EXPECT_EQ(n.received[0].source(), 1);
+    EXPECT_EQ(n.received[0].destination(), 5);
+
+    /* a route of its own wins over the default one */
+    n.r.add_route(5, n.g0);
+    n.send(5, 10);
+    EXPECT_EQ(n.r.get_statistics().same_interface, 1);
+
+    n.r.set_default_route(nullptr);
+    n.send(6, 10);
+    EXPECT_EQ(n.r.get_statistics().no_route, 1);
+    EXPECT_EQ(n.r.get_statistics().forwarded, 1);
+    EXPECT_EQ(n.received.size(), 1);
+}
+
 TEST(Fragmentation, Transfer)
 {
     //sp::loopback_interface interface(0, 1, 10, 64, 256);
@@ -573,6 +1581,449 @@ TEST(Ports, PacketConstructor)
     EXPECT_EQ(t2.destination(), 10);
 }
 
+namespace rpc_test
+{
+    struct call_state
+    {
+        std::optional<sp::packet> response;
+        bool done = false, destroyed = false;
+    };
+
+    /* flags the destruction of the coroutine's frame */
+    struct frame_guard
+    {
+        call_state & s;
+        ~frame_guard() {s.destroyed = true;}
+    };
+
+    sp::services::rpc::task ask(sp::services::rpc & r, sp::interface_identifier iid, call_state & s, sp::clock::duration timeout)
+    {
+        frame_guard g{s};
+        s.response = co_await r.call(3, iid, 5, sp::bytes(2), timeout);
+        s.done = true;
+    }
+
+    sp::packet respond_to(sp::packet & request)
+    {
+        sp::packet_metadata m = request.create_response();
+        sp::transfer t(sp::transfer_metadata(m), sp::bytes(4));
+        return sp::packet(std::move(t), m.source_port(), m.destination_port());
+    }
+
+    struct fixture
+    {
+        fixture()
+        {
+            r.bind_to(ports, 7);
+            r.transmit_event.subscribe([this](sp::packet p){sent.push_back(std::move(p));});
+            r.request_event.subscribe([this](sp::packet p){requests++;});
+        }
+
+        sp::ports_handler ports;
+        sp::services::rpc r;
+        std::vector<sp::packet> sent;
+        uint requests = 0;
+    };
+}
+
+TEST(Rpc, Match)
+{
+    rpc_test::fixture f;
+    rpc_test::call_state s;
+    sp::interface_identifier iid(sp::interface_identifier::identifier_type::LOOPBACK, 100);
+    rpc_test::ask(f.r, iid, s, 1s);
+    ASSERT_EQ(f.sent.size(), 1);
+    EXPECT_EQ(f.r.pending(), 1);
+    EXPECT_FALSE(s.done);
+
+    f.r.receive_callback(rpc_test::respond_to(f.sent[0]));
+    EXPECT_TRUE(s.done);
+    EXPECT_TRUE(s.destroyed);
+    ASSERT_TRUE(s.response.has_value());
+    EXPECT_EQ(s.response->source(), 3);
+    EXPECT_EQ(f.r.pending(), 0);
+    EXPECT_EQ(f.requests, 0);
+
+    /* answers nothing that is pending, so it is a request */
+    f.r.receive_callback(rpc_test::respond_to(f.sent[0]));
+    EXPECT_EQ(f.requests, 1);
+}
+
+TEST(Rpc, Timeout)
+{
+    rpc_test::fixture f;
+    rpc_test::call_state s;
+    sp::interface_identifier iid(sp::interface_identifier::identifier_type::LOOPBACK, 101);
+    rpc_test::ask(f.r, iid, s, 1ms);
+    EXPECT_NE(f.r.next_deadline(), sp::no_deadline());
+
+    std::this_thread::sleep_for(2ms);
+    f.r.main_task();
+    EXPECT_TRUE(s.done);
+    EXPECT_FALSE(s.response.has_value());
+    EXPECT_EQ(f.r.pending(), 0);
+    EXPECT_EQ(f.r.next_deadline(), sp::no_deadline());
+
+    /* the late response is not mistaken for the answer to anything */
+    f.r.receive_callback(rpc_test::respond_to(f.sent[0]));
+    EXPECT_EQ(f.requests, 1);
+}
+
+/* the ids are issued per interface, calls on two interfaces may share the id slot */
+TEST(Rpc, SlotCollision)
+{
+    rpc_test::fixture f;
+    rpc_test::call_state s1, s2;
+    sp::interface_identifier iid1(sp::interface_identifier::identifier_type::LOOPBACK, 102),
+        iid2(sp::interface_identifier::identifier_type::LOOPBACK, 103);
+    rpc_test::ask(f.r, iid1, s1, 1s);
+    rpc_test::ask(f.r, iid2, s2, 1s);
+    ASSERT_EQ(f.sent.size(), 2);
+    ASSERT_EQ(f.sent[0].get_id(), f.sent[1].get_id());
+
+    f.r.receive_callback(rpc_test::respond_to(f.sent[1]));
+    EXPECT_FALSE(s1.done);
+    EXPECT_TRUE(s2.done);
+    EXPECT_EQ(s2.response->interface_id(), iid2);
+    EXPECT_EQ(f.r.pending(), 1);
+
+    f.r.receive_callback(rpc_test::respond_to(f.sent[0]));
+    EXPECT_TRUE(s1.done);
+    EXPECT_EQ(s1.response->interface_id(), iid1);
+    EXPECT_EQ(f.r.pending(), 0);
+}
+
+/* pending calls are not resumed by the destructor, their coroutines are destroyed */
+TEST(Rpc, Destroy)
+{
+    rpc_test::call_state s;
+    {
+        rpc_test::fixture f;
+        sp::interface_identifier iid(sp::interface_identifier::identifier_type::LOOPBACK, 104);
+        rpc_test::ask(f.r, iid, s, 1s);
+    }
+    EXPECT_FALSE(s.done);
+    EXPECT_TRUE(s.destroyed);
+}
+
+namespace link_control_test
+{
+    /* what the link_control on the other end sends back */
+    sp::packet echo(sp::packet & request)
+    {
+        sp::packet_metadata m = request.create_response();
+        sp::transfer t(sp::transfer_metadata(m), sp::bytes(request.data()));
+        t.data()[0] = sp::byte(2); // PING_RESP
+        return sp::packet(std::move(t), m.source_port(), m.destination_port());
+    }
+
+    struct fixture
+    {
+        fixture()
+        {
+            lc.bind_to(ports, 0);
+            lc.transmit_event.subscribe([this](sp::packet p){sent.push_back(std::move(p));});
+        }
+
+        sp::ports_handler ports;
+        sp::services::link_control lc;
+        std::vector<sp::packet> sent;
+    };
+}
+
+TEST(LinkControl, PingSequence)
+{
+    link_control_test::fixture f;
+    sp::interface_identifier iid(sp::interface_identifier::identifier_type::LOOPBACK, 110);
+    f.lc.ping(3, iid);
+    f.lc.ping(3, iid);
+    ASSERT_EQ(f.sent.size(), 2);
+
+    /* out of order is fine, each ping is answered once */
+    f.lc.receive_callback(link_control_test::echo(f.sent[1]));
+    f.lc.receive_callback(link_control_test::echo(f.sent[0]));
+    EXPECT_EQ(f.lc.get_ping_statistics().received, 2);
+    EXPECT_EQ(f.lc.get_ping_statistics().lost(), 0);
+
+    /* a duplicated echo is not counted again */
+    f.lc.receive_callback(link_control_test::echo(f.sent[1]));
+    EXPECT_EQ(f.lc.get_ping_statistics().received, 2);
+    EXPECT_EQ(f.lc.get_ping_statistics().stale, 1);
+
+    /* neither is the late echo of a ping sent before the reset */
+    f.lc.ping(3, iid);
+    f.lc.reset_ping_statistics();
+    f.lc.receive_callback(link_control_test::echo(f.sent[2]));
+    EXPECT_EQ(f.lc.get_ping_statistics().received, 0);
+    EXPECT_EQ(f.lc.get_ping_statistics().stale, 1);
+}
+
+namespace pubsub_test
+{
+    enum : std::uint8_t {SUBSCRIBE = 1, UNSUBSCRIBE, PUBLISH};
+
+    /* what the pubsub service of node source sends us */
+    sp::packet message(std::uint8_t type, std::uint8_t topic, sp::interface::address_type source, 
+        sp::interface_identifier iid, sp::bytes payload = sp::bytes())
+    {
+        payload.expand(2, 0);
+        payload[0] = sp::byte(type);
+        payload[1] = sp::byte(topic);
+        sp::transfer t(sp::transfer_metadata(source, 1, iid, sp::fragment_metadata::stamp(), 1, 0), std::move(payload));
+        return sp::packet(std::move(t), 9, 9);
+    }
+
+    struct fixture
+    {
+        fixture()
+        {
+            ps.bind_to(ports, 9);
+            ps.transmit_event.subscribe([this](sp::packet p){sent.push_back(std::move(p));});
+        }
+
+        sp::ports_handler ports;
+        sp::services::pubsub ps;
+        std::vector<sp::packet> sent;
+        sp::interface_identifier bus{sp::interface_identifier::identifier_type::LOOPBACK, 120}, 
+            other{sp::interface_identifier::identifier_type::LOOPBACK, 121};
+    };
+}
+
+/* the subscribers on a broadcast bus share a single transfer */
+TEST(Pubsub, Broadcast)
+{
+    pubsub_test::fixture f;
+    f.ps.add_broadcast_bus(f.bus, 255);
+    f.ps.receive_callback(pubsub_test::message(pubsub_test::SUBSCRIBE, 5, 2, f.bus));
+    f.ps.receive_callback(pubsub_test::message(pubsub_test::SUBSCRIBE, 5, 3, f.bus));
+    /* subscribing again changes nothing */
+    f.ps.receive_callback(pubsub_test::message(pubsub_test::SUBSCRIBE, 5, 3, f.bus));
+    f.ps.receive_callback(pubsub_test::message(pubsub_test::SUBSCRIBE, 5, 4, f.other));
+    EXPECT_EQ(f.ps.remote_subscribers(5), 3);
+
+    f.ps.publish(5, sp::bytes(4));
+    ASSERT_EQ(f.sent.size(), 2);
+    EXPECT_EQ(f.sent[0].destination(), 255);
+    EXPECT_EQ(f.sent[0].interface_id(), f.bus);
+    EXPECT_EQ(f.sent[0].destination_port(), 9);
+    EXPECT_EQ(f.sent[1].destination(), 4);
+    EXPECT_EQ(f.sent[1].interface_id(), f.other);
+    for (auto & p : f.sent)
+    {
+        ASSERT_EQ(p.data().size(), 2 + 4);
+        EXPECT_EQ(p.data()[0], sp::byte(pubsub_test::PUBLISH));
+        EXPECT_EQ(p.data()[1], sp::byte(5));
+    }
+    EXPECT_EQ(f.ps.get_statistics().broadcasts, 1);
+    EXPECT_EQ(f.ps.get_statistics().unicasts, 1);
+}
+
+/* a lone subscriber on a broadcast bus gets a unicast */
+TEST(Pubsub, UnicastFallback)
+{
+    pubsub_test::fixture f;
+    f.ps.add_broadcast_bus(f.bus, 255);
+    f.ps.receive_callback(pubsub_test::message(pubsub_test::SUBSCRIBE, 5, 2, f.bus));
+    f.ps.publish(5, sp::bytes(4));
+    ASSERT_EQ(f.sent.size(), 1);
+    EXPECT_EQ(f.sent[0].destination(), 2);
+
+    f.ps.receive_callback(pubsub_test::message(pubsub_test::SUBSCRIBE, 5, 3, f.bus));
+    f.ps.publish(5, sp::bytes(4));
+    ASSERT_EQ(f.sent.size(), 2);
+    EXPECT_EQ(f.sent[1].destination(), 255);
+
+    /* back to one */
+    f.ps.receive_callback(pubsub_test::message(pubsub_test::UNSUBSCRIBE, 5, 2, f.bus));
+    f.ps.publish(5, sp::bytes(4));
+    ASSERT_EQ(f.sent.size(), 3);
+    EXPECT_EQ(f.sent[2].destination(), 3);
+    EXPECT_EQ(f.ps.get_statistics().unicasts, 2);
+    EXPECT_EQ(f.ps.get_statistics().broadcasts, 1);
+}
+
+TEST(Pubsub, Unsubscribe)
+{
+    pubsub_test::fixture f;
+    uint received = 0;
+    auto s = f.ps.subscribe(5, [&](const sp::bytes & payload){
+        EXPECT_EQ(payload.size(), 4);
+        received++;
+    });
+    f.ps.receive_callback(pubsub_test::message(pubsub_test::SUBSCRIBE, 5, 2, f.bus));
+
+    f.ps.publish(5, sp::bytes(4));
+    f.ps.receive_callback(pubsub_test::message(pubsub_test::PUBLISH, 5, 2, f.bus, sp::bytes(4)));
+    EXPECT_EQ(received, 2);
+    EXPECT_EQ(f.sent.size(), 1);
+
+    f.ps.unsubscribe(5, s);
+    f.ps.receive_callback(pubsub_test::message(pubsub_test::UNSUBSCRIBE, 5, 2, f.bus));
+    EXPECT_EQ(f.ps.remote_subscribers(5), 0);
+    f.ps.publish(5, sp::bytes(4));
+    f.ps.receive_callback(pubsub_test::message(pubsub_test::PUBLISH, 5, 2, f.bus, sp::bytes(4)));
+    EXPECT_EQ(received, 2);
+    EXPECT_EQ(f.sent.size(), 1);
+
+    /* and the other way around, we unsubscribe from a publisher */
+    f.ps.unsubscribe_remote(5, 2, f.bus);
+    ASSERT_EQ(f.sent.size(), 2);
+    EXPECT_EQ(f.sent[1].destination(), 2);
+    EXPECT_EQ(f.sent[1].data()[0], sp::byte(pubsub_test::UNSUBSCRIBE));
+    EXPECT_EQ(f.sent[1].data()[1], sp::byte(5));
+}
+
+namespace composed_test
+{
+    struct bottom_layer
+    {
+        bottom_layer(int step) : step(step) {}
+        bottom_layer(const bottom_layer &) = delete;
+        void main_task() {value += step; up.emit(value);}
+        sp::subject<int> up;
+        int value = 0, step;
+    };
+    struct middle_layer final
+    {
+        middle_layer(bottom_layer & b) : below(b) {}
+        middle_layer(const middle_layer &) = delete;
+        void receive(int v) {up.emit(v * 10);}
+        sp::subject<int> up;
+        bottom_layer & below;
+    };
+    struct top_layer final
+    {
+        void receive(int v) {received.push_back(v);}
+        std::vector<int> received;
+    };
+
+    void bind_layers(bottom_layer & l, middle_layer & u) {l.up.subscribe<&middle_layer::receive>(&u);}
+    void bind_layers(middle_layer & l, top_layer & u) {l.up.subscribe<&top_layer::receive>(&u);}
+}
+
+TEST(Stack, Composed)
+{
+    using namespace composed_test;
+    sp::stack::composed<bottom_layer, middle_layer, top_layer> s(
+        [](){return bottom_layer(2);},
+        [](bottom_layer & b){return middle_layer(b);},
+        [](middle_layer &){return top_layer();}
+    );
+
+    EXPECT_EQ(&s.get<1>().below, &s.bottom());
+    s.main_task();
+    s.main_task();
+    ASSERT_EQ(s.top().received.size(), 2);
+    EXPECT_EQ(s.top().received[0], 20);
+    EXPECT_EQ(s.top().received[1], 40);
+}
+
+namespace composed_test
+{
+    struct timed_layer
+    {
+        timed_layer() = default;
+        timed_layer(const timed_layer &) = delete;
+        void main_task() {++runs; if (pending) --pending;}
+        bool has_work() const noexcept {return pending > 0;}
+        sp::clock::time_point next_deadline() const noexcept {return deadline;}
+        std::atomic<uint> pending = 0;
+        uint runs = 0;
+        sp::clock::time_point deadline = sp::no_deadline();
+    };
+}
+
+TEST(Stack, WaitForWork)
+{
+    using namespace composed_test;
+    sp::stack::composed<timed_layer> s([](){return timed_layer();});
+
+    EXPECT_FALSE(s.has_work());
+    EXPECT_EQ(s.next_deadline(), sp::no_deadline());
+    s.top().pending = 3;
+    EXPECT_EQ(s.run_until_idle(), 3);
+    EXPECT_EQ(s.top().runs, 3);
+
+    /* nothing to do, waits for the whole timeout */
+    auto start = sp::clock::now();
+    EXPECT_FALSE(s.wait_for_work(20ms));
+    EXPECT_GE(sp::clock::now() - start, 20ms);
+
+    /* a layer's deadline comes before the timeout */
+    start = sp::clock::now();
+    s.top().deadline = start + 10ms;
+    EXPECT_TRUE(s.wait_for_work(1s));
+    EXPECT_GE(sp::clock::now() - start, 10ms);
+    EXPECT_LT(sp::clock::now() - start, 500ms);
+    s.top().deadline = sp::no_deadline();
+
+#ifdef SP_LINUX
+    /* work arriving from another thread */
+    start = sp::clock::now();
+    std::thread t([&]{
+        std::this_thread::sleep_for(10ms);
+        s.top().pending = 1;
+        s.get_wakeup().notify();
+    });
+    EXPECT_TRUE(s.wait_for_work(1s));
+    EXPECT_LT(sp::clock::now() - start, 500ms);
+    t.join();
+#endif
+}
+
+#ifdef SP_LINUX
+namespace composed_test
+{
+    /* stands in for a UART, its data is only seen once main_task reads the fd */
+    struct fd_layer
+    {
+        fd_layer(int fd) : fd(fd) {}
+        fd_layer(const fd_layer &) = delete;
+        void main_task()
+        {
+            char buff[16];
+            auto n = read(fd, buff, sizeof(buff));
+            if (n > 0)
+                received += n;
+        }
+        bool has_work() const noexcept {return false;}
+        int native_handle() const noexcept {return fd;}
+        int fd;
+        uint received = 0;
+    };
+}
+
+/* data waiting in the bottom layer's fd ends the wait */
+TEST(Stack, WaitForWorkFd)
+{
+    using namespace composed_test;
+    int fds[2];
+    ASSERT_EQ(pipe2(fds, O_NONBLOCK), 0);
+    sp::stack::composed<fd_layer> s([&](){return fd_layer(fds[0]);});
+
+    auto start = sp::clock::now();
+    std::thread t([&]{
+        std::this_thread::sleep_for(10ms);
+        [[maybe_unused]] auto r = write(fds[1], "ab", 2);
+    });
+    EXPECT_TRUE(s.wait_for_work(1s));
+    EXPECT_LT(sp::clock::now() - start, 500ms);
+    t.join();
+
+    /* still there, main_task has not read it yet */
+    start = sp::clock::now();
+    EXPECT_TRUE(s.wait_for_work(1s));
+    EXPECT_LT(sp::clock::now() - start, 500ms);
+
+    s.main_task();
+    EXPECT_EQ(s.bottom().received, 2);
+    EXPECT_FALSE(s.wait_for_work(10ms));
+
+    close(fds[0]);
+    close(fds[1]);
+}
+#endif
+
 /* TEST(Ports, PortsPing)
 {
     sp::loopback_interface interface(0, 1, 10, 64, 256);
@@ -0,0 +1,150 @@
+
+/* end-to-end throughput and latency of two complete stacks (interface + fragmentation + ports)
+ * connected back to back through a simulated link which drops serialized fragments at a given rate
+ *
+ *   a (1) --- link --- (2) b
+ *
+ * a sends transfers of a fixed payload size to a service on b, keeping up to `concurrency` of them
+ * in flight. The sweep covers payload sizes, loss rates and concurrency, every configuration is
+ * printed as a single JSON object per line:
+ *
+ *   {"payload": 256, "loss": 0.5, "concurrency": 4, "sent": 1000, "delivered": 1000, "lost": 0,
+ *    "goodput": 1234567, "p50_us": 12.3, "p99_us": 45.6, "p999_us": 78.9, "cpu_ns_per_byte": 1.2}
+ *
+ * goodput is in delivered payload bytes per second of wall time, latency is measured from handing
+ * the packet to the ports_handler of a until it is emitted by the service endpoint on b. Transfers
+ * not delivered within the timeout are counted as lost.
+ *
+ * usage: throughput [transfers per configuration]
+ */
+
+#include "libprotoserial/interface.hpp"
+#include "libprotoserial/fragmentation.hpp"
+#include "libprotoserial/ports/ports.hpp"
+#include "libprotoserial/protostacks.hpp"
+
+#include "helpers/random.hpp"
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+using namespace std;
+using namespace std::chrono_literals;
+
+static constexpr sp::ports_handler::port_type service_port = 1;
+
+struct node
+{
+    node(sp::interface_identifier::instance_type instance, sp::interface::address_type address, uint rate) :
+        stack(instance, address, rate), service(ports.register_port(service_port))
+    {
+        ports.register_interface(stack.interface.interface_id(), stack.fragmentation);
+    }
+
+    void main_task() {stack.main_task();}
+
+    sp::stack::virtual_full stack;
+    sp::ports_handler ports;
+    sp::ports_handler::service_endpoint & service;
+};
+
+/* moves the serialized fragments from src to dst, loss is the percentage of fragments dropped */
+void link(sp::virtual_interface & src, sp::virtual_interface & dst, double loss)
+{
+    while (src.has_serialized())
+    {
+        auto b = src.get_serialized();
+        if (loss == 0 || !chance(loss))
+            dst.put_serialized(std::move(b));
+    }
+}
+
+double percentile(const vector<double> & sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    auto i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[min(i, sorted.size() - 1)];
+}
+
+void run(uint payload, double loss, uint concurrency, uint count, sp::clock::duration timeout)
+{
+    node a(0, 1, 10000000), b(1, 2, 10000000);
+    auto iid = a.stack.interface.interface_id();
+
+    map<uint32_t, sp::clock::time_point> in_flight;
+    vector<double> latency;
+    latency.reserve(count);
+    uint sent = 0, delivered = 0, lost = 0;
+    uint64_t delivered_bytes = 0;
+
+    b.service.receive_event.subscribe([&](sp::packet p){
+        uint32_t seq;
+        if (p.data().size() < sizeof(seq))
+            return;
+        memcpy(&seq, p.data().data(), sizeof(seq));
+        auto it = in_flight.find(seq);
+        /* duplicates and transfers already given up on */
+        if (it == in_flight.end())
+            return;
+        latency.push_back(chrono::duration<double, micro>(sp::clock::now() - it->second).count());
+        in_flight.erase(it);
+        ++delivered;
+        delivered_bytes += p.data().size();
+    });
+
+    auto cpu_start = clock();
+    auto start = chrono::steady_clock::now();
+    while (delivered + lost < count)
+    {
+        while (sent < count && in_flight.size() < concurrency)
+        {
+            sp::bytes data(max<uint>(payload, sizeof(uint32_t)));
+            uint32_t seq = sent++;
+            memcpy(data.data(), &seq, sizeof(seq));
+            sp::transfer t(sp::transfer_metadata(0, 2, iid, sp::clock::now(), sp::global_id_factory.new_id(iid), 0), std::move(data));
+            in_flight[seq] = sp::clock::now();
+            a.service.transmit_callback(sp::packet(std::move(t), service_port, service_port));
+        }
+
+        a.main_task();
+        link(a.stack.interface, b.stack.interface, loss);
+        b.main_task();
+        link(b.stack.interface, a.stack.interface, loss);
+
+        auto now = sp::clock::now();
+        erase_if(in_flight, [&](const auto & e){
+            if (now - e.second < timeout)
+                return false;
+            ++lost;
+            return true;
+        });
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    double cpu = double(clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    sort(latency.begin(), latency.end());
+    cout << "{\"payload\": " << payload << ", \"loss\": " << loss << ", \"concurrency\": " << concurrency
+        << ", \"sent\": " << sent << ", \"delivered\": " << delivered << ", \"lost\": " << lost
+        << ", \"goodput\": " << (uint64_t)(delivered_bytes / elapsed.count())
+        << ", \"p50_us\": " << percentile(latency, 0.5) << ", \"p99_us\": " << percentile(latency, 0.99)
+        << ", \"p999_us\": " << percentile(latency, 0.999)
+        << ", \"cpu_ns_per_byte\": " << (delivered_bytes ? cpu * 1e9 / delivered_bytes : 0) << "}" << endl;
+}
+
+int main(int argc, char const *argv[])
+{
+    uint count = argc > 1 ? atoi(argv[1]) : 1000;
+
+    for (uint payload : {16, 64, 256, 1024, 4096})
+        for (double loss : {0.0, 0.5, 2.0, 5.0})
+            for (uint concurrency : {1, 4, 16})
+                run(payload, loss, concurrency, count, 2s);
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+
+/* round trip latency of a single fragment through a UART interface looped back onto itself, for
+ * every combination of the serial settings (baudrate, low_latency, flow_control) and for the classic
+ * Bxxxx constructor which leaves the driver defaults in place
+ *
+ * with a device argument the port must have its TX wired to RX (and RTS to CTS for the flow control
+ * runs), without one a pty stands in for it, a thread echoes everything written into the slave back.
+ * A pty has no baudrate, no latency timer and no modem lines, the settings are accepted but the
+ * numbers only show the overhead of the stack and the tty layer, the effect of each setting shows
+ * on real hardware, the latency timer of USB adapters being the big one.
+ *
+ * every configuration is printed as a single JSON object per line:
+ *
+ *   {"baudrate": 1000000, "low_latency": true, "low_latency_applied": false, "flow_control": false,
+ *    "received": 200, "p50_us": 12.3, "p99_us": 45.6}
+ *
+ * baudrate 0 stands for the classic constructor with B115200
+ *
+ * usage: tty_latency [device] [fragments per configuration]
+ */
+
+#include "libprotoserial/interface.hpp"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <optional>
+#include <memory>
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+
+using namespace std;
+using namespace std::chrono_literals;
+
+struct interface : public sp::uart_interface
+{
+    using sp::uart_interface::uart_interface;
+    using sp::uart_interface::do_receive;
+};
+
+/* the master side of a pty pair echoing everything back */
+struct pty_echo
+{
+    pty_echo() : master(posix_openpt(O_RDWR | O_NOCTTY))
+    {
+        grantpt(master);
+        unlockpt(master);
+        termios tty;
+        tcgetattr(master, &tty);
+        cfmakeraw(&tty);
+        tcsetattr(master, TCSANOW, &tty);
+        echo = thread([this]{
+            uint8_t buff[256];
+            pollfd pfd{master, POLLIN, 0};
+            while (running)
+            {
+                if (poll(&pfd, 1, 10) <= 0)
+                    continue;
+                auto n = read(master, buff, sizeof(buff));
+                if (n > 0)
+                    [[maybe_unused]] auto w = write(master, buff, n);
+            }
+        });
+    }
+    ~pty_echo()
+    {
+        running = false;
+        echo.join();
+        close(master);
+    }
+    string slave() const {return ptsname(master);}
+
+    int master;
+    atomic<bool> running = true;
+    thread echo;
+};
+
+double percentile(const vector<double> & sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    auto i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[min(i, sorted.size() - 1)];
+}
+
+void run(const string & port, optional<interface::serial_config> config, uint count)
+{
+    /* the fragments are sent to 2, they come back as someone else's */
+    auto i = config ? make_unique<interface>(port, *config, 0, 1, 255, 10, 64, 1024) :
+        make_unique<interface>(port, B115200, 0, 1, 255, 10, 64, 1024);
+    /* the constructor has applied it already, this only finds out whether low_latency stuck */
+    bool applied = config ? i->configure(*config) : false;
+
+    uint received = 0;
+    i->other_receive_event.subscribe([&](sp::fragment){received++;});
+
+    vector<double> latency;
+    latency.reserve(count);
+    pollfd pfd{i->native_handle(), POLLIN, 0};
+    for (uint n = 0; n < count; n++)
+    {
+        auto expected = received + 1;
+        auto start = chrono::steady_clock::now();
+        i->transmit(sp::fragment(2, sp::bytes(32)));
+        while (received < expected)
+        {
+            i->main_task();
+            i->do_receive();
+            if (received < expected && poll(&pfd, 1, 100) == 0)
+                break;
+        }
+        if (received == expected)
+            latency.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+    }
+
+    sort(latency.begin(), latency.end());
+    cout << "{\"baudrate\": " << (config ? config->baudrate : 0)
+        << ", \"low_latency\": " << (config && config->low_latency ? "true" : "false")
+        << ", \"low_latency_applied\": " << (applied && config->low_latency ? "true" : "false")
+        << ", \"flow_control\": " << (config && config->flow_control ? "true" : "false")
+        << ", \"received\": " << received << ", \"p50_us\": " << percentile(latency, 0.5)
+        << ", \"p99_us\": " << percentile(latency, 0.99) << "}" << endl;
+}
+
+int main(int argc, char const *argv[])
+{
+    optional<pty_echo> pty;
+    string port;
+    if (argc > 1)
+        port = argv[1];
+    else
+        port = pty.emplace().slave();
+    uint count = argc > 2 ? atoi(argv[2]) : 200;
+
+    run(port, nullopt, count);
+    for (uint baudrate : {115200, 1000000, 3000000})
+        for (bool low_latency : {false, true})
+            for (bool flow_control : {false, true})
+                run(port, interface::serial_config{baudrate, flow_control, low_latency}, count);
+
+    return 0;
+}